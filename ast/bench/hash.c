@@ -0,0 +1,120 @@
+/*
+ * A microbenchmark for `kn_hash`: it measures the hash's throughput for keys of different
+ * lengths, and how many distinct strings stay in the `KN_STRING_CACHE` table after they're all
+ * created (which depends on how well the hash spreads out similar keys).
+ *
+ * Build and run it with `make bench`.
+ */
+#include "../src/knight.h"
+#include "../src/string.h"
+#include "../src/shared.h"
+#include "../src/allocator.h"
+#include <stdio.h>  /* printf, snprintf */
+#include <stdlib.h> /* rand, srand */
+#include <time.h>   /* clock, CLOCKS_PER_SEC */
+
+#define BUFFER_LENGTH (1 << 16)
+#define BYTES_PER_LENGTH (1 << 28)
+
+static char buffer[BUFFER_LENGTH + 1024];
+
+static void throughput(void) {
+	static const size_t lengths[] = { 1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 64, 128, 256, 1024 };
+	// Make sure the hashes aren't optimized out.
+	volatile kn_hash_t sink = 0;
+
+	printf("%8s %12s %12s\n", "length", "ns/hash", "MiB/s");
+
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+		size_t length = lengths[i];
+		size_t iterations = BYTES_PER_LENGTH / length / 16 + 1;
+		clock_t start = clock();
+
+		// Vary the offset so that keys aren't always aligned.
+		for (size_t j = 0; j < iterations; ++j)
+			sink += kn_hash(buffer + (j * 7 & (BUFFER_LENGTH - 1)), length);
+
+		double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+		printf("%8zu %12.2f %12.1f\n", length,
+			seconds * 1e9 / iterations,
+			(double) (iterations * length) / seconds / (1 << 20));
+	}
+}
+
+#ifdef KN_STRING_CACHE
+static const char *const kinds[] = { "identifiers", "integers", "random" };
+
+static size_t make_key(char *key, size_t kind, size_t index) {
+	switch (kind) {
+	case 0:
+		return (size_t) snprintf(key, 32, "var_%zu", index);
+
+	case 1:
+		return (size_t) snprintf(key, 32, "%zu", index * 3);
+
+	default: {
+		size_t length = 1 + (size_t) rand() % 16;
+
+		for (size_t i = 0; i < length; ++i)
+			key[i] = (char) ('a' + rand() % 26);
+
+		return length;
+	}
+	}
+}
+
+static void hit_rate(void) {
+	static const size_t counts[] = { 1000, 10000, 100000 };
+
+	printf("\n%12s %8s %8s\n", "keys", "count", "hit rate");
+
+	for (size_t kind = 0; kind < sizeof(kinds) / sizeof(kinds[0]); ++kind) {
+		for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+			size_t count = counts[i], hits = 0;
+			struct kn_string **strings = kn_heap_alloc_array(struct kn_string *, count);
+			char key[32];
+
+			srand(1);
+			for (size_t j = 0; j < count; ++j) {
+				size_t length = make_key(key, kind, j);
+				strings[j] = kn_string_new_borrowed(key, length);
+			}
+
+			// A string's still cached if looking it up again finds it.
+			for (size_t j = 0; j < count; ++j) {
+				const char *str = kn_string_deref(strings[j]);
+				size_t length = kn_length(strings[j]);
+
+				if (kn_string_cache_lookup(kn_hash(str, length), length) == strings[j])
+					++hits;
+			}
+
+			for (size_t j = 0; j < count; ++j)
+				kn_string_free(strings[j]);
+
+			kn_heap_free(strings);
+			kn_string_cleanup();
+
+			printf("%12s %8zu %7.2f%%\n", kinds[kind], count, 100.0 * hits / count);
+		}
+	}
+}
+#endif /* KN_STRING_CACHE */
+
+int main(void) {
+	kn_startup();
+
+	srand(0);
+	for (size_t i = 0; i < sizeof(buffer); ++i)
+		buffer[i] = (char) rand();
+
+	throughput();
+
+#ifdef KN_STRING_CACHE
+	hit_rate();
+#endif /* KN_STRING_CACHE */
+
+	kn_shutdown();
+	return 0;
+}
@@ -1,6 +1,196 @@
+#if !defined(_DEFAULT_SOURCE) && defined(KN_HEAP_SLAB)
+# define _DEFAULT_SOURCE /* for `MAP_ANON` and `MAP_NORESERVE` */
+#endif /* !_DEFAULT_SOURCE */
+
 #include "allocator.h"
 
+#ifdef KN_HEAP_SLAB
+# include <stdbool.h>  /* bool, true */
+# include <stdint.h>   /* uintptr_t */
+# include <string.h>   /* memcpy */
+# include <sys/mman.h> /* mmap */
+
+# if defined(__SANITIZE_ADDRESS__)
+#  include <sanitizer/asan_interface.h>
+#  define POISON(ptr, size) ASAN_POISON_MEMORY_REGION(ptr, size)
+#  define UNPOISON(ptr, size) ASAN_UNPOISON_MEMORY_REGION(ptr, size)
+# else
+#  define POISON(ptr, size) ((void) (ptr), (void) (size))
+#  define UNPOISON(ptr, size) ((void) (ptr), (void) (size))
+# endif /* __SANITIZE_ADDRESS__ */
+
+/*
+ * The slab allocator carves fixed-size pages out of a single reserved region of memory. Every page
+ * is dedicated to a single size class, and freed objects are kept on a per-class free list, so
+ * that allocating and freeing small objects is just pushing and popping a pointer.
+ *
+ * Since all pages come from the same region, `kn_heap_free` can tell whether a pointer came from
+ * a slab or `malloc` by just checking its address.
+ */
+static const size_t class_sizes[KN_HEAP_SLAB_NCLASSES] = {
+	16, 32, 48, 64, 80, 96, 112, 128,
+	160, 192, 224, 256,
+	320, 384, 448, 512,
+	640, 768, 896, KN_HEAP_SLAB_MAX_SIZE
+};
+
+static struct slab_class {
+	// Freed objects, each of which points to the next.
+	void *free_list;
+
+	// The unused part of the newest page belonging to this class.
+	char *next, *end;
+
+	struct kn_heap_slab_stats stats;
+} classes[KN_HEAP_SLAB_NCLASSES];
+
+// Which class to use for each `size`, in 16 byte increments.
+static unsigned char size_classes[KN_HEAP_SLAB_MAX_SIZE / 16 + 1];
+
+// The class that each page in `region` belongs to.
+static unsigned char page_classes[KN_HEAP_SLAB_REGION_SIZE / KN_HEAP_SLAB_PAGE_SIZE];
+
+static char *region, *region_next;
+static size_t fallbacks;
+
+static void slab_init(void) {
+	region = mmap(
+		NULL,
+		KN_HEAP_SLAB_REGION_SIZE,
+		PROT_READ | PROT_WRITE,
+		MAP_ANON | MAP_PRIVATE | MAP_NORESERVE,
+		-1,
+		0
+	);
+
+	// If we can't reserve the region, every allocation will just fall back to `malloc`.
+	if (region == MAP_FAILED)
+		region = NULL;
+
+	region_next = region;
+
+	for (size_t size = 0, class = 0; size <= KN_HEAP_SLAB_MAX_SIZE; size += 16) {
+		while (class_sizes[class] < size)
+			++class;
+
+		size_classes[size / 16] = (unsigned char) class;
+	}
+
+	for (size_t class = 0; class < KN_HEAP_SLAB_NCLASSES; ++class)
+		classes[class].stats.size = class_sizes[class];
+}
+
+static bool in_slab(const void *ptr) {
+	// Pointers below `region` wrap around, so this also handles `NULL`.
+	return region != NULL && (uintptr_t) ptr - (uintptr_t) region < KN_HEAP_SLAB_REGION_SIZE;
+}
+
+static void *slab_alloc(size_t size) {
+	if (KN_UNLIKELY(region_next == NULL)) {
+		static bool initialized;
+
+		if (initialized)
+			return NULL;
+
+		initialized = true;
+		slab_init();
+
+		if (region == NULL)
+			return NULL;
+	}
+
+	size_t index = size_classes[(size + 15) / 16];
+	struct slab_class *class = &classes[index];
+	void *ptr = class->free_list;
+
+	if (KN_LIKELY(ptr != NULL)) {
+		UNPOISON(ptr, class->stats.size);
+		class->free_list = *(void **) ptr;
+		++class->stats.hits;
+		return ptr;
+	}
+
+	++class->stats.misses;
+
+	if (KN_UNLIKELY(class->end - class->next < (ptrdiff_t) class->stats.size)) {
+		if (KN_UNLIKELY(region_next == region + KN_HEAP_SLAB_REGION_SIZE))
+			return NULL;
+
+		page_classes[(region_next - region) / KN_HEAP_SLAB_PAGE_SIZE] = (unsigned char) index;
+		class->next = region_next;
+		class->end = region_next += KN_HEAP_SLAB_PAGE_SIZE;
+	}
+
+	ptr = class->next;
+	class->next += class->stats.size;
+	return ptr;
+}
+
+static size_t slab_size(const void *ptr) {
+	return class_sizes[page_classes[((const char *) ptr - region) / KN_HEAP_SLAB_PAGE_SIZE]];
+}
+
+void kn_heap_free(void *ptr) {
+	if (!in_slab(ptr)) {
+		free(ptr);
+		return;
+	}
+
+	struct slab_class *class = &classes[page_classes[((char *) ptr - region) / KN_HEAP_SLAB_PAGE_SIZE]];
+
+	*(void **) ptr = class->free_list;
+	class->free_list = ptr;
+	++class->stats.frees;
+	POISON(ptr, class->stats.size);
+}
+
+const struct kn_heap_slab_stats *kn_heap_slab_stats(size_t *fallbacks_out) {
+	static struct kn_heap_slab_stats stats[KN_HEAP_SLAB_NCLASSES];
+
+	for (size_t class = 0; class < KN_HEAP_SLAB_NCLASSES; ++class) {
+		stats[class] = classes[class].stats;
+		stats[class].size = class_sizes[class];
+	}
+
+	*fallbacks_out = fallbacks;
+	return stats;
+}
+
+void kn_heap_dump_stats(FILE *out) {
+	size_t fallbacks;
+	const struct kn_heap_slab_stats *stats = kn_heap_slab_stats(&fallbacks);
+	size_t hits = 0, misses = 0;
+
+	fprintf(out, "%6s %12s %12s %12s\n", "size", "hits", "misses", "frees");
+
+	for (size_t class = 0; class < KN_HEAP_SLAB_NCLASSES; ++class) {
+		hits += stats[class].hits;
+		misses += stats[class].misses;
+
+		if (stats[class].hits || stats[class].misses)
+			fprintf(out, "%6zu %12zu %12zu %12zu\n",
+				stats[class].size, stats[class].hits, stats[class].misses, stats[class].frees);
+	}
+
+	fprintf(out, "slab: %zu hits, %zu misses, %zu malloc fallbacks, %zu pages\n",
+		hits, misses, fallbacks,
+		region == NULL ? 0 : (size_t) (region_next - region) / KN_HEAP_SLAB_PAGE_SIZE);
+}
+#endif /* KN_HEAP_SLAB */
+
 void *kn_heap_malloc(size_t size) {
+#ifdef KN_HEAP_SLAB
+	if (KN_LIKELY(size <= KN_HEAP_SLAB_MAX_SIZE)) {
+		void *ptr = slab_alloc(size);
+
+		if (KN_LIKELY(ptr != NULL))
+			return ptr;
+
+		// Only count small allocations, as larger ones never use the slab in the first place.
+		++fallbacks;
+	}
+#endif /* KN_HEAP_SLAB */
+
 	void *ptr = malloc(size);
 
 #ifdef KN_RECKLESS
@@ -18,6 +208,23 @@ void *kn_heap_malloc(size_t size) {
 }
 
 void *kn_heap_realloc(void *ptr, size_t size) {
+#ifdef KN_HEAP_SLAB
+	if (ptr == NULL)
+		return kn_heap_malloc(size);
+
+	if (in_slab(ptr)) {
+		size_t old_size = slab_size(ptr);
+
+		if (size <= old_size)
+			return ptr;
+
+		void *newptr = kn_heap_malloc(size);
+		memcpy(newptr, ptr, old_size);
+		kn_heap_free(ptr);
+		return newptr;
+	}
+#endif /* KN_HEAP_SLAB */
+
 	void *newptr = realloc(ptr, size);
 
 #ifdef KN_RECKLESS
@@ -9,20 +9,27 @@
 # error cant use both gc and refcount
 #endif
 
+#if defined(KN_AST_CACHE) && defined(KN_USE_GC)
+# error the ast cache is redundant with the gc, which reuses freed asts itself
+#endif
+
 #define KN_VALUE_ALIGNMENT 8
 
 #ifdef KN_USE_REFCOUNT
 # define KN_HEADER alignas(KN_VALUE_ALIGNMENT) size_t refcount; \
-                   unsigned char flags;
+                   unsigned int flags;
 #else
-# define KN_HEADER alignas(KN_VALUE_ALIGNMENT) unsigned char flags;
+# define KN_HEADER alignas(KN_VALUE_ALIGNMENT) unsigned int flags;
 #endif /* KN_USE_REFCOUNT */
 
-#define kn_flags(ptr) KN_CLANG_IGNORE("-Wcast-qual", (((unsigned char *)(ptr))[offsetof(struct { KN_HEADER }, flags)]))
+#define kn_flags(ptr) KN_CLANG_IGNORE("-Wcast-qual", \
+	(*(unsigned int *) ((char *) (ptr) + offsetof(struct { KN_HEADER }, flags))))
 
 #ifdef KN_USE_GC
 # include "gc.h"
-# define KN_GC_FL_MARKED (1 << ((8 * sizeof(unsigned int)) - 1))
+// The flag that's set on reachable values during a collection; it's the highest bit that still
+// fits within an `enum`.
+# define KN_GC_FL_MARKED (1 << 30)
 #endif
 
 
@@ -82,6 +89,57 @@ void *
 #endif
 kn_heap_realloc(void *ptr, size_t size);
 
+#ifdef KN_HEAP_SLAB
+# include <stdio.h> /* FILE */
+
+/**
+ * The largest allocation that's served from a slab; larger ones go directly to `malloc`.
+ **/
+# define KN_HEAP_SLAB_MAX_SIZE 1024
+# define KN_HEAP_SLAB_NCLASSES 20
+
+/**
+ * How much address space is reserved for slabs. Only pages that are actually used are backed by
+ * physical memory, and once it's exhausted allocations fall back to `malloc`.
+ **/
+# ifndef KN_HEAP_SLAB_REGION_SIZE
+#  define KN_HEAP_SLAB_REGION_SIZE ((size_t) 1 << 30)
+# endif /* !KN_HEAP_SLAB_REGION_SIZE */
+
+/**
+ * The size of each slab; every slab only holds allocations from a single size class.
+ **/
+# ifndef KN_HEAP_SLAB_PAGE_SIZE
+#  define KN_HEAP_SLAB_PAGE_SIZE ((size_t) 1 << 16)
+# endif /* !KN_HEAP_SLAB_PAGE_SIZE */
+
+/**
+ * Statistics about a single slab size class.
+ **/
+struct kn_heap_slab_stats {
+	size_t size;   // the size of every allocation in this class
+	size_t hits;   // allocations that reused a freed allocation
+	size_t misses; // allocations that had to be carved out of a slab
+	size_t frees;  // allocations that were returned to the class
+};
+
+/**
+ * Returns the stats for each of the `KN_HEAP_SLAB_NCLASSES` size classes, and stores the amount
+ * of allocations that fell back to `malloc` because the slab was exhausted in `fallbacks`. (Ones
+ * larger than `KN_HEAP_SLAB_MAX_SIZE` always use `malloc`, and aren't counted.)
+ **/
+const struct kn_heap_slab_stats *kn_heap_slab_stats(size_t *fallbacks);
+
+/**
+ * Prints the slab statistics to `out`.
+ **/
+void kn_heap_dump_stats(FILE *out);
+
+/**
+ * Frees the memory at `ptr`, returning it to its slab if it was allocated from one.
+ **/
+void kn_heap_free(void *ptr);
+#else
 /**
  * Frees the memory at `ptr`
  */
@@ -89,5 +147,6 @@ static inline void kn_heap_free(void *ptr) {
 	extern void free(void *);
 	free(ptr);
 }
+#endif /* KN_HEAP_SLAB */
 
 #endif
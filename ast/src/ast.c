@@ -3,32 +3,72 @@
 #include <assert.h>
 
 #ifdef KN_AST_CACHE
-# ifndef KN_AST_FREE_CACHE_LEN
-#  define KN_AST_FREE_CACHE_LEN 32
-# endif /* !KN_AST_FREE_CACHE_LEN */
-static struct kn_ast *freed_asts[KN_MAX_ARGC + 1][KN_AST_FREE_CACHE_LEN];
+// Freed asts of each arity, threaded together through `next_free`.
+static struct {
+	struct kn_ast *top;
+	size_t length;
+} freed_asts[KN_MAX_ARGC + 1];
+
+static size_t max_freed_asts = KN_AST_FREE_CACHE_LEN;
+static struct kn_ast_cache_stats stats;
+
+static struct kn_ast *pop_freed_ast(size_t argc) {
+	struct kn_ast *ast = freed_asts[argc].top;
+
+	if (ast != NULL) {
+		freed_asts[argc].top = ast->next_free;
+		--freed_asts[argc].length;
+	}
+
+	return ast;
+}
+
+void kn_ast_cache_set_length(size_t length) {
+	max_freed_asts = length;
+
+	for (size_t i = 0; i <= KN_MAX_ARGC; ++i) {
+		while (length < freed_asts[i].length) {
+			kn_heap_free(pop_freed_ast(i));
+			++stats.released;
+		}
+	}
+}
+
+struct kn_ast_cache_stats kn_ast_cache_stats(void) {
+	return stats;
+}
+
+void kn_ast_cache_dump_stats(FILE *out) {
+	size_t allocs = stats.reused + stats.allocated;
+
+	fprintf(out, "ast cache: %zu of %zu allocations reused (%.1f%%), %zu cached, %zu released\n",
+		stats.reused, allocs, allocs ? 100.0 * stats.reused / allocs : 0.0,
+		stats.cached, stats.released);
+}
 #endif /* KN_AST_CACHE */
 
 void kn_ast_cleanup(void) {
-#if defined(KN_AST_CACHE) && defined(KN_USE_REFCOUNT)
+#ifdef KN_AST_CACHE
 	for (size_t i = 0; i <= KN_MAX_ARGC; ++i) {
-		for (size_t j = 0; j < KN_AST_FREE_CACHE_LEN; ++j) {
-			struct kn_ast *ast = freed_asts[i][j];
+		struct kn_ast *ast;
 
-			if (ast != NULL) {
-				assert(ast->refcount == 0);
-				kn_heap_free(ast);
-			}
+		while ((ast = pop_freed_ast(i)) != NULL) {
+# ifdef KN_USE_REFCOUNT
+			assert(ast->refcount == 0);
+# endif /* KN_USE_REFCOUNT */
+			kn_heap_free(ast);
 		}
 	}
-#endif /* KN_AST_CACHE && KN_USE_REFCOUNT */
+#endif /* KN_AST_CACHE */
 }
 
 #ifdef KN_USE_GC
-void kn_ast_mark(struct kn_ast *ast) {
-	kn_flags(ast) |= KN_AST_FL_MARKED;
+void kn_ast_mark(const struct kn_ast *ast) {
+	// Asts are zeroed when allocated, so if the function isn't set, neither are the args.
+	if (ast->function == NULL)
+		return;
 
-	for (size_t i = 0; i < ast->function->arity; ++i)
+	for (size_t i = 0; i < ast->argc; ++i)
 		kn_value_mark(ast->args[i]);
 }
 #endif /* KN_USE_GC */
@@ -37,18 +77,9 @@ struct kn_ast *kn_ast_alloc(size_t argc) {
 	struct kn_ast *ast;
 
 #ifdef KN_AST_CACHE
-	assert(argc <= KN_MAX_ARGC);
-
-	// Try to find a freed ast we can repurpose.
-	for (size_t i = 0; i < KN_AST_FREE_CACHE_LEN; ++i) {
-		ast = freed_asts[argc][i];
-
- 		// If it's null, then we can't repurpose it.
-		if (ast == NULL)
-			continue;
-
-		// Don't let others use this one.
-		freed_asts[argc][i] = NULL;
+	// Try to repurpose a freed ast.
+	if (argc <= KN_MAX_ARGC && (ast = pop_freed_ast(argc)) != NULL) {
+		++stats.reused;
 
 # ifdef KN_USE_REFCOUNT
 		// Sanity check.
@@ -58,18 +89,27 @@ struct kn_ast *kn_ast_alloc(size_t argc) {
 		++ast->refcount;
 # endif /* KN_USE_REFCOUNT */
 
+		ast->argc = (unsigned int) argc;
 		return ast;
 	}
+
+	++stats.allocated;
 #endif /* KN_AST_CACHE */
 
 	// There are no cached free asts, so we have to allocate.
+#ifdef KN_USE_GC
+	assert(argc <= KN_MAX_ARGC);
+	(void) argc;
+	ast = kn_gc_malloc(struct kn_ast, KN_GC_KIND_AST);
+#else
 	ast = kn_heap_malloc(sizeof(struct kn_ast) + sizeof(kn_value) * argc);
-	// ast = kn_gc_malloc(struct kn_ast);
+#endif /* KN_USE_GC */
 
 #ifdef KN_USE_REFCOUNT
 	ast->refcount = 1;
 #endif /* KN_USE_REFCOUNT */
 
+	ast->argc = (unsigned int) argc;
 	return ast;
 }
 
@@ -78,32 +118,48 @@ void kn_ast_dealloc(struct kn_ast *ast) {
 	assert(ast->refcount == 0);
 #endif /* KN_USE_REFCOUNT */
 
-	size_t arity = ast->function->arity;
-
 	// Free all arguments associated with this ast.
-	for (size_t i = 0; i < arity; ++i)
+	for (size_t i = 0; i < ast->argc; ++i)
 		kn_value_free(ast->args[i]);
 
+	kn_ast_dealloc_shallow(ast);
+}
+
+void kn_ast_dealloc_shallow(struct kn_ast *ast) {
+#ifdef KN_USE_REFCOUNT
+	// The optimizer discards asts it still holds the parser's only reference to.
+	assert(ast->refcount <= 1);
+	ast->refcount = 0;
+#endif /* KN_USE_REFCOUNT */
+
 #ifdef KN_AST_CACHE
+	size_t argc = ast->argc;
+
 	// Attempt to cache this ast, so another allocation can reuse its space.
-	for (size_t i = 0; i < KN_AST_FREE_CACHE_LEN; ++i) {
-		// If the freed slot is unused, claim it.
-		if (freed_asts[arity][i] == NULL) {
-			freed_asts[arity][i] = ast;
-			return;
-		}
+	if (argc <= KN_MAX_ARGC && freed_asts[argc].length < max_freed_asts) {
+		ast->next_free = freed_asts[argc].top;
+		freed_asts[argc].top = ast;
+		++freed_asts[argc].length;
+		++stats.cached;
+		return;
 	}
+
+	++stats.released;
 #endif /* KN_AST_CACHE */
-	
+
+#ifdef KN_USE_GC
+	(void) ast; // the collector reclaims it.
+#else
 	// All free slots are used, we cannot repurpose it.
 	kn_heap_free(ast);
+#endif /* KN_USE_GC */
 }
 
 void kn_ast_dump(const struct kn_ast *ast, FILE *out) {
 	fputs("AST(", out);
 	fputs(ast->function->name, out);
 
-	for (size_t i = 0; i < ast->function->arity; ++i) {
+	for (size_t i = 0; i < ast->argc; ++i) {
 		fputs(", ", out);
 		kn_value_dump(ast->args[i], out);
 	}
@@ -5,8 +5,11 @@
 #include "function.h"
 #include "value.h"
 #include "shared.h"
+#include <stddef.h> /* offsetof */
 
-#define KN_AST_FL_MARKED KN_GC_FL_MARKED
+#ifdef KN_USE_GC
+# define KN_AST_FL_MARKED KN_GC_FL_MARKED
+#endif /* KN_USE_GC */
 
 /**
  * The type that represents a function and its arguments in Knight.
@@ -20,9 +23,24 @@ struct kn_ast {
 	KN_HEADER
 
 	/*
-	 * The function associated with this ast.
+	 * The number of arguments. This is the function's arity, except for sequences (`;` asts),
+	 * which hold every statement of a chain of `;`s. (It's an `unsigned int` so that it fits in
+	 * the padding after the header.)
 	 */
-	const struct kn_function *function;
+	unsigned int argc;
+
+	union {
+		/*
+		 * The function associated with this ast. Some functions replace this with versions
+		 * specialized for the types they've seen (eg `kn_fn_add_integer`) when they're run.
+		 */
+		const struct kn_function *function;
+
+		/*
+		 * The next ast in the free list; only used by asts in the ast cache.
+		 */
+		struct kn_ast *next_free;
+	};
 
 	/*
 	 * The arguments of this ast.
@@ -35,19 +53,66 @@ struct kn_ast {
  **/
 void KN_COLD kn_ast_cleanup(void);
 
+#ifdef KN_AST_CACHE
+/**
+ * Statistics about how effective the ast cache is.
+ **/
+struct kn_ast_cache_stats {
+	size_t reused;    // allocations that reused a cached ast
+	size_t allocated; // allocations that had to allocate a new ast
+	size_t cached;    // deallocations that stored the ast in the cache
+	size_t released;  // deallocations that freed the ast, as the cache was full
+};
+
+/**
+ * The default amount of freed asts of each arity that are kept around to be reused; see
+ * `kn_ast_cache_set_length`.
+ **/
+# ifndef KN_AST_FREE_CACHE_LEN
+#  define KN_AST_FREE_CACHE_LEN 32
+# endif /* !KN_AST_FREE_CACHE_LEN */
+
+/**
+ * Sets the maximum amount of freed asts of each arity that are kept around to be reused.
+ *
+ * If the cache currently holds more than `length` asts of an arity, the excess are freed.
+ * `kn_startup` calls this with the `KN_AST_FREE_CACHE_LEN` environment variable, if it's set.
+ **/
+void kn_ast_cache_set_length(size_t length);
+
+/**
+ * Returns the ast cache's statistics.
+ **/
+struct kn_ast_cache_stats kn_ast_cache_stats(void);
+
+/**
+ * Prints the ast cache's statistics to `out`.
+ **/
+void kn_ast_cache_dump_stats(FILE *out);
+#endif /* KN_AST_CACHE */
+
 /**
- * Allocates a new `kn_ast` with the given number of arguments.
+ * Allocates a new `kn_ast` with the given number of arguments, setting its `argc`.
  *
- * `argc` shouldn't be larger than `KN_MAX_ARGC`.
+ * Asts with more than `KN_MAX_ARGC` arguments aren't cached by `KN_AST_CACHE`, and can't be
+ * allocated when using `KN_USE_GC`, as they wouldn't fit in a cell.
  **/
 struct kn_ast *kn_ast_alloc(size_t argc);
 
 /**
  * Deallocates the memory associated with `ast`; should only be called with
  * an ast with a zero refcount.
+ *
+ * When using `KN_USE_GC`, this is only called by the collector, and doesn't free the ast itself.
  **/
 void KN_COLD kn_ast_dealloc(struct kn_ast *ast);
 
+/**
+ * Deallocates `ast` like `kn_ast_dealloc`, but without freeing its arguments, eg because they've
+ * been moved elsewhere. It may have a refcount of one, for the caller's reference.
+ **/
+void kn_ast_dealloc_shallow(struct kn_ast *ast);
+
 /**
  * Releases the memory resources associated with this struct.
  **/
@@ -63,9 +128,22 @@ static inline void kn_ast_free(struct kn_ast *ast)  {
 }
 
 #ifdef KN_USE_GC
-void kn_ast_mark(struct kn_ast *ast);
+/**
+ * Marks all the arguments of `ast` as reachable.
+ **/
+void kn_ast_mark(const struct kn_ast *ast);
 #endif /* KN_USE_GC */
 
+/**
+ * Returns the ast whose arguments are `args`.
+ *
+ * Functions are only ever called with the arguments of the ast they belong to, so they can use this
+ * to find it, eg to read its `argc` or to change its `function`.
+ **/
+static inline struct kn_ast *kn_ast_of_args(const kn_value *args) {
+	return (struct kn_ast *) (void *) ((char *) args - offsetof(struct kn_ast, args));
+}
+
 /**
  * Executes a `kn_ast`, returning the function's result.
  **/
@@ -16,6 +16,18 @@
 	KN_HEADER \
 	size_t length;
 
+#ifdef KN_CONTAINER_CACHE
+/**
+ * Containers can't change once they're created, so things derived from their contents can be
+ * computed once and then kept around. This declares the `cached` fields that follow a container's
+ * header; they're filled in lazily, and each is only valid when its flag (such as
+ * `KN_STRING_FL_HASHED`) is set.
+ **/
+# define KN_CONTAINER_CACHED(fields) struct fields cached;
+#else
+# define KN_CONTAINER_CACHED(fields)
+#endif /* KN_CONTAINER_CACHE */
+
 #define kn_length(x) (x)->length
 // struct kn_container {
 // 	/**
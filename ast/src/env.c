@@ -10,92 +10,164 @@
  *
  * Therefore, whenever a variable is referenced in the source code, it's given
  * an entry, even if it's never actually assigned.
+ *
+ * Variables are stored in an open-addressing hash table (with linear probing)
+ * of pointers, which doubles in size whenever it gets three-quarters full.
+ * Since the variables themselves are allocated separately, growing the table
+ * never moves them, and so `kn_variable` pointers stay valid.
  **/
 
-#include <string.h>  /* strdup, strcmp */
+#include <string.h>  /* memcmp */
 #include <assert.h>  /* assert */
-#include <stdlib.h>  /* free */
-#include <stdbool.h> /* bool, true, false */
 #include "env.h"     /* prototypes, size_t, kn_variable, kn_value, KN_UNDEFINED,
                         kn_value_free, kn_value_clone */
-#include "shared.h"  /* kn_die, kn_heap_malloc, kn_heap_realloc, kn_hash, KN_UNLIKELY */
+#include "shared.h"  /* kn_heap_malloc, kn_heap_free, kn_hash, KN_UNLIKELY */
+#include "string.h"  /* kn_string_intern, kn_string_deref */
 
-struct kn_env {
-	size_t capacity_per_bucket, number_of_buckets;
+#if KN_ENV_INITIAL_CAPACITY == 0 || (KN_ENV_INITIAL_CAPACITY & (KN_ENV_INITIAL_CAPACITY - 1))
+# error env capacity must be a power of two
+#endif /* KN_ENV_INITIAL_CAPACITY is not a power of two */
 
-	struct kn_env_bucket {
-		size_t length;
-		struct kn_variable *variables;
-	} *buckets;
+struct kn_env {
+	// `capacity` is always a power of two, so `hash & (capacity - 1)` is a slot.
+	size_t length, capacity;
+
+	struct kn_env_slot {
+		// The variable's hash is kept alongside it, so that probing doesn't have
+		// to look at the names of variables which can't match.
+		kn_hash_t hash;
+		struct kn_variable *variable;
+	} *slots;
+
+#ifdef KN_USE_GC
+	// Every live environment is a root for the collector, so they're all linked together.
+	struct kn_env *next_live;
+#endif /* KN_USE_GC */
 };
 
-struct kn_env *kn_env_create(size_t capacity_per_bucket, size_t number_of_buckets) {
-	struct kn_env *env = kn_heap_alloc(struct kn_env);
+#ifdef KN_USE_GC
+static struct kn_env *live_envs;
 
-	env->capacity_per_bucket = capacity_per_bucket;
-	env->number_of_buckets = number_of_buckets;
-	env->buckets = kn_heap_alloc_array(struct kn_env_bucket, number_of_buckets);
+void kn_env_mark_all(void) {
+	for (struct kn_env *env = live_envs; env != NULL; env = env->next_live) {
+		for (size_t i = 0; i < env->capacity; ++i) {
+			struct kn_variable *variable = env->slots[i].variable;
 
-	for (size_t i = 0; i < number_of_buckets; ++i) {
-		env->buckets[i].length = 0;
-		env->buckets[i].variables = kn_heap_alloc_array(
-			struct kn_variable,
-			capacity_per_bucket
-		);
+			if (variable != NULL && variable->value != KN_UNDEFINED)
+				kn_value_mark(variable->value);
+		}
 	}
+}
+#endif /* KN_USE_GC */
+
+static struct kn_env_slot *allocate_slots(size_t capacity) {
+	struct kn_env_slot *slots = kn_heap_alloc_array(struct kn_env_slot, capacity);
+
+	for (size_t i = 0; i < capacity; ++i)
+		slots[i].variable = NULL;
+
+	return slots;
+}
+
+struct kn_env *kn_env_create(void) {
+	struct kn_env *env = kn_heap_alloc(struct kn_env);
+
+	env->length = 0;
+	env->capacity = KN_ENV_INITIAL_CAPACITY;
+	env->slots = allocate_slots(env->capacity);
+
+#ifdef KN_USE_GC
+	env->next_live = live_envs;
+	live_envs = env;
+#endif /* KN_USE_GC */
 
 	return env;
 }
 
 void kn_env_destroy(struct kn_env *env) {
-	for (size_t i = 0; i < env->number_of_buckets; ++i) {
-		struct kn_env_bucket *bucket = &env->buckets[i];
-
-		for (size_t len = 0; len < bucket->length; ++len) {
-			// All identifiers are owned, and only marked `const` so
-			// that users dont modify them (as it'd break the hash
-			// function).
-			KN_CLANG_IGNORE("-Wcast-qual",
-				kn_heap_free((char *) bucket->variables[len].name);
-			)
-
-			// If the variable was defined in the source code, but
-			// never assigned, it'll have a value of `KN_UNDEFINED`.
-			if (bucket->variables[len].value != KN_UNDEFINED)
-				kn_value_free(bucket->variables[len].value);
-		}
+#ifdef KN_USE_GC
+	struct kn_env **live = &live_envs;
+
+	while (*live != env)
+		live = &(*live)->next_live;
 
-		kn_heap_free(bucket->variables);
+	*live = env->next_live;
+#endif /* KN_USE_GC */
+
+	for (size_t i = 0; i < env->capacity; ++i) {
+		struct kn_variable *variable = env->slots[i].variable;
+
+		if (variable == NULL)
+			continue;
+
+		// Names are interned, so they're freed by `kn_string_intern_teardown`.
+
+		// If the variable was defined in the source code, but
+		// never assigned, it'll have a value of `KN_UNDEFINED`.
+		if (variable->value != KN_UNDEFINED)
+			kn_value_free(variable->value);
+
+		kn_heap_free(variable);
 	}
 
+	kn_heap_free(env->slots);
 	kn_heap_free(env);
 }
 
+// Doubles the amount of slots, moving every variable into its new slot.
+static void grow(struct kn_env *env) {
+	size_t capacity = env->capacity * 2;
+	struct kn_env_slot *slots = allocate_slots(capacity);
+
+	for (size_t i = 0; i < env->capacity; ++i) {
+		if (env->slots[i].variable == NULL)
+			continue;
+
+		size_t index = env->slots[i].hash & (capacity - 1);
+
+		while (slots[index].variable != NULL)
+			index = (index + 1) & (capacity - 1);
+
+		slots[index] = env->slots[i];
+	}
+
+	kn_heap_free(env->slots);
+	env->slots = slots;
+	env->capacity = capacity;
+}
+
 struct kn_variable *kn_env_fetch(struct kn_env *env, const char *identifier, size_t length) {
 	assert(length != 0);
 
 	kn_hash_t hash = kn_hash(identifier, length);
-	struct kn_env_bucket *bucket = &env->buckets[hash & (env->number_of_buckets - 1)];
+	size_t index = hash & (env->capacity - 1);
 
-	for (size_t i = 0; i < bucket->length; ++i) {
-		struct kn_variable *variable = &bucket->variables[i];
+	for (; env->slots[index].variable != NULL; index = (index + 1) & (env->capacity - 1)) {
+		struct kn_variable *variable = env->slots[index].variable;
 
 		// If the variable already exists, return it.
-		if (!strncmp(variable->name, identifier, length))
-			return variable;
+		if (
+			env->slots[index].hash == hash
+			&& variable->length == length
+			&& !memcmp(variable->name, identifier, length)
+		) return variable;
 	}
 
-	// If the bucket is full, then too many variables have been defined.
-	if (KN_UNLIKELY(bucket->length == env->capacity_per_bucket))
-		kn_die("too many variables created!");
-
-	struct kn_variable *variable = &bucket->variables[bucket->length++];
+	struct kn_variable *variable = kn_heap_alloc(struct kn_variable);
 
 	// Uninitialized variables start with an undefined starting value. The
 	// new variable with an undefined starting value, so that any attempt to
 	// access it will be invalid.
 	variable->value = KN_UNDEFINED;
-	variable->name = kn_memdup(identifier, length);
+	variable->name = kn_string_deref(kn_string_intern(identifier, length));
+	variable->length = length;
+
+	env->slots[index].hash = hash;
+	env->slots[index].variable = variable;
+
+	// Keep at least a quarter of the slots empty, so that probes stay short.
+	if (KN_UNLIKELY(env->capacity * 3 / 4 < ++env->length))
+		grow(env);
 
 	return variable;
 }
@@ -5,6 +5,14 @@
 #include "shared.h"
 #include <stddef.h>
 
+/**
+ * How many variables an environment has room for when it's created; it's grown
+ * as needed. Must be a power of two.
+ **/
+#ifndef KN_ENV_INITIAL_CAPACITY
+# define KN_ENV_INITIAL_CAPACITY 64
+#endif /* !KN_ENV_INITIAL_CAPACITY */
+
 // it's declared within `env.c
 struct kn_env;
 
@@ -13,7 +21,7 @@ struct kn_env;
  *
  * This _must_ be called before `kn_env_fetch` is called.
  **/
-struct kn_env *kn_env_create(size_t capacity_per_bucket, size_t number_of_buckets);
+struct kn_env *kn_env_create(void);
 
 /**
  * Frees all resources associated with given Knight environment.
@@ -22,12 +30,19 @@ struct kn_env *kn_env_create(size_t capacity_per_bucket, size_t number_of_bucket
  **/
 void kn_env_destroy(struct kn_env *env);
 
+#ifdef KN_USE_GC
+/**
+ * Marks the values of every variable in every live environment as reachable.
+ **/
+void kn_env_mark_all(void);
+#endif /* KN_USE_GC */
+
 /**
  * A variable within Knight.
  *
  * This struct is only returned via `kn_env_fetch`, and lives for the remainder
- * of the program's lifetime. (Or, at least until `kn_env_free` is called.) As
- * such, there is no need to free it.
+ * of the program's lifetime. (Or, at least until `kn_env_destroy` is called.)
+ * As such, there is no need to free it.
  **/
 struct kn_variable {
 	/*
@@ -39,9 +54,15 @@ struct kn_variable {
 	kn_value value;
 
 	/*
-	 * The name of this variable.
+	 * The name of this variable, which isn't `\0`-terminated. It's the contents
+	 * of an interned string, so it lives until `kn_string_intern_teardown`.
 	 */
 	const char *name;
+
+	/*
+	 * The length of `name`.
+	 */
+	size_t length;
 };
 
 /**
@@ -75,7 +96,7 @@ static inline void kn_variable_assign(
  **/
 static inline kn_value kn_variable_run(struct kn_variable *variable) {
 	if (KN_UNLIKELY(variable->value == KN_UNDEFINED))
-		kn_error("undefined variable '%s'", variable->name);
+		kn_error("undefined variable '%.*s'", (int) variable->length, variable->name);
 
 	return kn_value_clone(variable->value);
 }
@@ -84,7 +105,7 @@ static inline void kn_variable_dump(
 	const struct kn_variable *variable,
 	FILE *out
 ) {
-	fprintf(out, "Variable(%s)", variable->name);
+	fprintf(out, "Variable(%.*s)", (int) variable->length, variable->name);
 }
 
 #endif /* !KN_ENV_H */
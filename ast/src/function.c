@@ -5,7 +5,7 @@
 #include "function.h" /* prototypes */
 #include "knight.h"   /* kn_play */
 
-#include "ast.h"      /* kn_ast_run */
+#include "ast.h"      /* kn_ast_run, kn_ast_of_args */
 #include "env.h"      /* kn_env_fetch, kn_variable, kn_variable_run,
                          kn_variable_assign */
 #include "list.h"  
@@ -15,8 +15,8 @@
 #include "string.h"   /* kn_string, kn_string_new_owned, kn_string_new_borrowed,
                          kn_string_alloc, kn_string_free, kn_string_empty,
                          kn_string_deref, kn_string_length, kn_string_cache,
-                         kn_string_clone_static, kn_string_cache_lookup,
-                         kn_string_equal */
+                         kn_string_cache_lookup,
+                         kn_string_equal, kn_string_bytes */
 #include "value.h"    /* kn_value, kn_integer, KN_TRUE, KN_FALSE, KN_NULL,
                          KN_UNDEFINED, new_value_number, new_value_string,
                          new_value_boolean, kn_value_clone, kn_value_free,
@@ -29,6 +29,7 @@
 #include <assert.h>   /* assert */
 #include <stdlib.h>   /* rand, srand, free, exit, size_t, NULL */
 #include <stdbool.h>  /* bool */
+#include <stdint.h>   /* uint64_t */
 #include <stdio.h>    /* fflush, fputs, putc, puts, feof, ferror, FILE, getline,
                          clearerr, stdout, stdin, popen, fread, pclose */
 #include <time.h>     /* time */
@@ -90,8 +91,6 @@ DECLARE_FUNCTION(prompt, 0, "PROMPT") {
 	if (length && line[length - 1] == '\r')
 		--length;
 
-	line[length] = '\0';
-
 	if (KN_UNLIKELY(length == 0)) {
 		kn_heap_free(line);
 		return kn_value_new(&kn_string_empty);
@@ -131,6 +130,9 @@ DECLARE_FUNCTION(box, 1, ",") {
 	assert(kn_flags(list) & KN_LIST_FL_EMBED);
 	list->embed[0] = kn_value_run(args[0]);
 
+	if (kn_value_is_integer(list->embed[0]))
+		kn_flags(list) |= KN_LIST_FL_ONLY_INTEGERS;
+
 	return kn_value_new(list);
 }
 
@@ -152,7 +154,7 @@ DECLARE_FUNCTION(head, 1, "[") {
 		return head;
 	} else {
 		struct kn_string *string = kn_value_as_string(ran);
-		struct kn_string *head = kn_string_new_borrowed(kn_string_deref(string), 1);
+		struct kn_string *head = kn_string_clone(&kn_string_bytes[(unsigned char) kn_string_deref(string)[0]]);
 
 		kn_string_free(string);
 		return kn_value_new(head);
@@ -215,13 +217,18 @@ DECLARE_FUNCTION(call, 1, "CALL") {
 DECLARE_FUNCTION(system, 1, "$") {
 	struct kn_string *command = kn_value_to_string(args[0]);
 
-	const char *str = kn_string_deref(command);
+	// Strings aren't nul-terminated, but `popen` needs them to be.
+	char *str = kn_heap_malloc(kn_length(command) + 1);
+	memcpy(str, kn_string_deref(command), kn_length(command));
+	str[kn_length(command)] = '\0';
+	kn_string_free(command);
+
 	FILE *stream = popen(str, "r");
 
 	if (stream == NULL)
 		kn_error("unable to execute command '%s'.", str);
 
-	kn_string_free(command);
+	kn_heap_free(str);
 
 	size_t tmp;
 	size_t capacity = 2048;
@@ -242,9 +249,6 @@ DECLARE_FUNCTION(system, 1, "$") {
 	if (ferror(stream))
 		kn_error("unable to read command stream");
 
-	result = kn_heap_realloc(result, length + 1);
-	result[length] = '\0';
-
 	// Abort if we cant close stream.
 	if (pclose(stream) == -1)
 		kn_error("unable to close command stream");
@@ -307,8 +311,14 @@ DECLARE_FUNCTION(dump, 1, "DUMP") {
 	return ran;
 }
 
-DECLARE_FUNCTION(output, 1, "OUTPUT") {
-	struct kn_string *string = kn_value_to_string(args[0]);
+static void flush_output(void) {
+	fflush(stdout);
+	if (ferror(stdout))
+		kn_error("unable to write to stdout");
+}
+
+// Writes `string` and a newline, unless it ends with `\`, in which case that's omitted instead.
+static void output_string(struct kn_string *string) {
 	char *str = kn_string_deref(string);
 
 #ifndef KN_RECKLESS
@@ -323,11 +333,12 @@ DECLARE_FUNCTION(output, 1, "OUTPUT") {
 		putchar('\n');
 	}
 
-	fflush(stdout);
-	if (ferror(stdout))
-		kn_error("unable to write to stdout");
-
+	flush_output();
 	kn_string_free(string);
+}
+
+DECLARE_FUNCTION(output, 1, "OUTPUT") {
+	output_string(kn_value_to_string(args[0]));
 	return KN_NULL;
 }
 
@@ -356,8 +367,7 @@ DECLARE_FUNCTION(ascii, 1, "ASCII") {
 	if (integer <= 0 || 127 < integer)
 		kn_error("Integer %" PRIdkn " is out of range for ascii char.", integer);
 
-	char buf[2] = { (char) integer, 0 };
-	return kn_value_new(kn_string_new_borrowed(buf, 1));
+	return kn_value_new(kn_string_clone(&kn_string_bytes[integer]));
 }
 
 #ifdef KN_EXT_VALUE
@@ -374,9 +384,61 @@ DECLARE_FUNCTION(negate, 1, "~") {
 	return kn_value_new((kn_integer) -kn_value_to_integer(args[0]));
 }
 
-DECLARE_FUNCTION(add, 2, "+") {
-	kn_value lhs = kn_value_run(args[0]);
+/*
+ * Quickening: `+`, `-`, `*`, `<`, and `>` rewrite the ast they're called on to a version that's
+ * specialized for integers once they see two integer operands, skipping the checks for the other
+ * types. When the specialized version sees anything else, it reverts the ast to the generic version,
+ * which can specialize it again later.
+ */
+static inline void quicken(const kn_value *args, const struct kn_function *function) {
+	struct kn_ast *ast = kn_ast_of_args(args);
+
+	if (ast->function != function)
+		ast->function = function;
+}
+
+// Converts `value`, which has already been run, to an integer, and frees it.
+static inline kn_integer ran_to_integer(kn_value value) {
+	kn_integer integer = kn_value_to_integer(value);
+	kn_value_free(value);
+	return integer;
+}
+
+// Runs the right-hand side of a generic function whose left-hand side is an integer, converting it
+// to an integer. If it was already one, the ast is quickened to `integer_function`.
+static kn_integer integer_rhs(const kn_value *args, const struct kn_function *integer_function) {
+	kn_value rhs = kn_value_run(args[1]);
+
+	if (kn_value_is_integer(rhs))
+		quicken(args, integer_function);
 
+	return ran_to_integer(rhs);
+}
+
+// Declares `kn_fn_<name>_integer`, which `kn_fn_<name>` is quickened to, and which computes
+// `lhs operator rhs` directly. If either operand isn't an integer, it reverts the ast and finishes
+// the way `kn_fn_<name>` would, via `generic_<name>`.
+#define DECLARE_INTEGER_FUNCTION(name, symbol, operator, type)                                   \
+	DECLARE_FUNCTION(name##_integer, 2, symbol) {                                               \
+		kn_value lhs = kn_value_run(args[0]);                                                    \
+                                                                                                 \
+		if (KN_UNLIKELY(!kn_value_is_integer(lhs))) {                                            \
+			quicken(args, &kn_fn_##name);                                                        \
+			return generic_##name(args, lhs);                                                    \
+		}                                                                                        \
+                                                                                                 \
+		kn_value rhs = kn_value_run(args[1]);                                                    \
+                                                                                                 \
+		if (KN_UNLIKELY(!kn_value_is_integer(rhs))) {                                            \
+			quicken(args, &kn_fn_##name);                                                        \
+			return kn_value_new((type) (kn_value_as_integer(lhs) operator ran_to_integer(rhs))); \
+		}                                                                                        \
+                                                                                                 \
+		return kn_value_new((type) (kn_value_as_integer(lhs) operator kn_value_as_integer(rhs))); \
+	}
+
+// Adds `args[1]` to `lhs`, which has already been run.
+static kn_value generic_add(const kn_value *args, kn_value lhs) {
 	switch (kn_tag(lhs)) {
 	case KN_TAG_LIST:
 		return kn_value_new(kn_list_concat(
@@ -392,7 +454,7 @@ DECLARE_FUNCTION(add, 2, "+") {
 
 	case KN_TAG_INTEGER:
 		return kn_value_new(
-			kn_value_as_integer(lhs) + kn_value_to_integer(args[1])
+			kn_value_as_integer(lhs) + integer_rhs(args, &kn_fn_add_integer)
 		);
 
 	default:
@@ -400,19 +462,29 @@ DECLARE_FUNCTION(add, 2, "+") {
 	}
 }
 
-DECLARE_FUNCTION(sub, 2, "-") {
-	kn_value lhs = kn_value_run(args[0]);
+DECLARE_FUNCTION(add, 2, "+") {
+	return generic_add(args, kn_value_run(args[0]));
+}
 
+DECLARE_INTEGER_FUNCTION(add, "+", +, kn_integer)
+
+// Subtracts `args[1]` from `lhs`, which has already been run.
+static kn_value generic_sub(const kn_value *args, kn_value lhs) {
 	if (!kn_value_is_integer(lhs))
 		kn_error("can only subtract from integers");
 
-	return kn_value_new(kn_value_as_integer(lhs) - kn_value_to_integer(args[1]));
+	return kn_value_new(kn_value_as_integer(lhs) - integer_rhs(args, &kn_fn_sub_integer));
 }
 
-DECLARE_FUNCTION(mul, 2, "*") {
-	kn_value lhs = kn_value_run(args[0]);
-	kn_integer rhs = kn_value_to_integer(args[1]);
+DECLARE_FUNCTION(sub, 2, "-") {
+	return generic_sub(args, kn_value_run(args[0]));
+}
+
+DECLARE_INTEGER_FUNCTION(sub, "-", -, kn_integer)
 
+// Multiplies an integer `lhs`, or repeats a string or list `lhs`, by `rhs`. `lhs` has already been
+// run.
+static kn_value multiply(kn_value lhs, kn_integer rhs) {
 	if (kn_value_is_integer(lhs))
 		return kn_value_new(kn_value_as_integer(lhs) * rhs);
 
@@ -429,6 +501,20 @@ DECLARE_FUNCTION(mul, 2, "*") {
 	return kn_value_new(kn_list_repeat(kn_value_as_list(lhs), rhs));
 }
 
+// Multiplies `lhs`, which has already been run, by `args[1]`.
+static kn_value generic_mul(const kn_value *args, kn_value lhs) {
+	if (kn_value_is_integer(lhs))
+		return kn_value_new(kn_value_as_integer(lhs) * integer_rhs(args, &kn_fn_mul_integer));
+
+	return multiply(lhs, kn_value_to_integer(args[1]));
+}
+
+DECLARE_FUNCTION(mul, 2, "*") {
+	return generic_mul(args, kn_value_run(args[0]));
+}
+
+DECLARE_INTEGER_FUNCTION(mul, "*", *, kn_integer)
+
 DECLARE_FUNCTION(div, 2, "/") {
 	kn_value lhs = kn_value_run(args[0]);
 
@@ -457,9 +543,71 @@ DECLARE_FUNCTION(mod, 2, "%") {
 	return kn_value_new(kn_value_as_integer(lhs) % base);
 }
 
-DECLARE_FUNCTION(pow, 2, "^") {
+// Returns `log2(power)`, for a `power` of two; it's the shift the `_pow2` functions below use.
+static inline unsigned log2_pow2(kn_integer power) {
+	assert(1 < power && (power & (power - 1)) == 0);
+
+#if KN_HAS_BUILTIN(__builtin_ctzll)
+	return (unsigned) __builtin_ctzll((unsigned long long) power);
+#else
+	unsigned shift = 0;
+
+	while ((power >>= 1) != 0)
+		++shift;
+
+	return shift;
+#endif /* KN_HAS_BUILTIN(__builtin_ctzll) */
+}
+
+/*
+ * `*`, `/`, and `%` by a literal power of two, which the optimizer emits in place of the usual
+ * functions. Integers are shifted and masked rather than multiplied and divided, and anything else
+ * is handled just as the usual functions would.
+ */
+DECLARE_FUNCTION(mul_pow2, 2, "*") {
 	kn_value lhs = kn_value_run(args[0]);
+	kn_integer power = kn_value_as_integer(args[1]);
+
+	if (KN_LIKELY(kn_value_is_integer(lhs)))
+		return kn_value_new((kn_integer) ((uint64_t) kn_value_as_integer(lhs) << log2_pow2(power)));
+
+	return multiply(lhs, power);
+}
+
+DECLARE_FUNCTION(div_pow2, 2, "/") {
+	kn_value lhs = kn_value_run(args[0]);
+	kn_integer power = kn_value_as_integer(args[1]);
+
+	if (!kn_value_is_integer(lhs))
+		kn_error("can only divide integers");
+
+	// Shifting rounds down, so negative numbers are biased to round towards zero like `/` does.
+	kn_integer dividend = kn_value_as_integer(lhs);
 
+	if (dividend < 0)
+		dividend += power - 1;
+
+	return kn_value_new(dividend >> log2_pow2(power));
+}
+
+DECLARE_FUNCTION(mod_pow2, 2, "%") {
+	kn_value lhs = kn_value_run(args[0]);
+	kn_integer power = kn_value_as_integer(args[1]);
+
+	if (!kn_value_is_integer(lhs))
+		kn_error("can only modulo integers");
+
+	// Like `%`, the remainder of a negative number is negative.
+	kn_integer dividend = kn_value_as_integer(lhs);
+
+	if (dividend < 0)
+		return kn_value_new(-(-dividend & (power - 1)));
+
+	return kn_value_new(dividend & (power - 1));
+}
+
+// Exponentiates an integer `lhs`, or joins a list `lhs`, by `rhs`. `lhs` has already been run.
+static kn_value power(kn_value lhs, kn_value rhs) {
 	if (!kn_value_is_list(lhs) && !kn_value_is_integer(lhs))
 		kn_error("can only exponentiate integers and lists");
 
@@ -469,7 +617,7 @@ DECLARE_FUNCTION(pow, 2, "^") {
 
 		kn_integer power = (kn_integer) powl(
 			(long double) kn_value_as_integer(lhs),
-			(long double) kn_value_to_integer(args[1])
+			(long double) kn_value_to_integer(rhs)
 		);
 
 		KN_CLANG_DIAG_POP
@@ -478,7 +626,7 @@ DECLARE_FUNCTION(pow, 2, "^") {
 	}
 
 	struct kn_list *list = kn_value_as_list(lhs);
-	struct kn_string *sep = kn_value_to_string(args[1]);
+	struct kn_string *sep = kn_value_to_string(rhs);
 	struct kn_string *joined = kn_list_join(list, sep);
 
 	kn_list_free(list);
@@ -487,6 +635,46 @@ DECLARE_FUNCTION(pow, 2, "^") {
 	return kn_value_new(joined);
 }
 
+DECLARE_FUNCTION(pow, 2, "^") {
+	return power(kn_value_run(args[0]), args[1]);
+}
+
+// `OUTPUT ^ list sep`, which the optimizer fuses so that the joined list is written straight to
+// stdout without building the joined string.
+DECLARE_FUNCTION(output_join, 2, "OUTPUT^") {
+	kn_value lhs = kn_value_run(args[0]);
+
+	if (!kn_value_is_list(lhs)) {
+		kn_value result = power(lhs, args[1]);
+		output_string(kn_value_to_string(result));
+		kn_value_free(result);
+		return KN_NULL;
+	}
+
+	struct kn_list *list = kn_value_as_list(lhs);
+	struct kn_string *sep = kn_value_to_string(args[1]);
+
+#ifndef KN_RECKLESS
+	clearerr(stdout);
+#endif /* !KN_RECKLESS */
+
+	// The last byte is held back, as a trailing `\` suppresses the newline instead.
+	int last = kn_list_join_write(list, sep, stdout);
+
+	if (last != '\\') {
+		if (last != EOF)
+			putchar(last);
+
+		putchar('\n');
+	}
+
+	flush_output();
+	kn_list_free(list);
+	kn_string_free(sep);
+
+	return KN_NULL;
+}
+
 DECLARE_FUNCTION(eql, 2, "?") {
 	kn_value lhs = kn_value_run(args[0]);
 	kn_value rhs = kn_value_run(args[1]);
@@ -499,30 +687,46 @@ DECLARE_FUNCTION(eql, 2, "?") {
 	return kn_value_new(equal);
 }
 
-DECLARE_FUNCTION(lth, 2, "<") {
-	kn_value lhs = kn_value_run(args[0]);
+// Compares `lhs`, which has already been run, with `args[1]`. If they're both integers, the ast is
+// quickened to `integer_function`.
+static kn_integer compare(
+	const kn_value *args,
+	kn_value lhs,
+	const struct kn_function *integer_function
+) {
 	kn_value rhs = kn_value_run(args[1]);
 
-	kn_boolean lesser = kn_value_compare(lhs, rhs) < 0;
+	if (kn_value_is_integer(lhs) && kn_value_is_integer(rhs))
+		quicken(args, integer_function);
+
+	kn_integer cmp = kn_value_compare(lhs, rhs);
 
 	kn_value_free(lhs);
 	kn_value_free(rhs);
 
-	return kn_value_new(lesser);
+	return cmp;
 }
 
-DECLARE_FUNCTION(gth, 2, ">") {
-	kn_value lhs = kn_value_run(args[0]);
-	kn_value rhs = kn_value_run(args[1]);
+static kn_value generic_lth(const kn_value *args, kn_value lhs) {
+	return kn_value_new((kn_boolean) (compare(args, lhs, &kn_fn_lth_integer) < 0));
+}
 
-	kn_boolean greater = kn_value_compare(lhs, rhs) > 0;
+DECLARE_FUNCTION(lth, 2, "<") {
+	return generic_lth(args, kn_value_run(args[0]));
+}
 
-	kn_value_free(lhs);
-	kn_value_free(rhs);
+DECLARE_INTEGER_FUNCTION(lth, "<", <, kn_boolean)
 
-	return kn_value_new(greater);
+static kn_value generic_gth(const kn_value *args, kn_value lhs) {
+	return kn_value_new((kn_boolean) (compare(args, lhs, &kn_fn_gth_integer) > 0));
 }
 
+DECLARE_FUNCTION(gth, 2, ">") {
+	return generic_gth(args, kn_value_run(args[0]));
+}
+
+DECLARE_INTEGER_FUNCTION(gth, ">", >, kn_boolean)
+
 DECLARE_FUNCTION(and, 2, "&") {
 	kn_value lhs = kn_value_run(args[0]);
 
@@ -545,15 +749,74 @@ DECLARE_FUNCTION(or, 2, "|") {
 	return kn_value_run(args[1]);
 }
 
+// `;` asts are sequences, holding every statement of a chain like `; a ; b c` (see `argc`).
 DECLARE_FUNCTION(then, 2, ";") {
-	// We ensured the first value was an ast in the parser.
-	assert(kn_value_is_ast(args[0]));
+	while (true) {
+		size_t last = kn_ast_of_args(args)->argc - 1;
 
-	kn_value_free(kn_ast_run(kn_value_as_ast(args[0])));
+		for (size_t i = 0; i < last; ++i) {
+			// We ensured every statement but the last was an ast in the parser.
+			assert(kn_value_is_ast(args[i]));
 
-	return kn_value_run(args[1]);
+			kn_value_free(kn_ast_run(kn_value_as_ast(args[i])));
+		}
+
+		// Sequences that end with another one (such as the ones `KN_USE_GC` splits long chains into)
+		// continue with its statements, rather than recursing.
+		if (!kn_value_is_ast(args[last]) || kn_value_as_ast(args[last])->function != &kn_fn_then)
+			return kn_value_run(args[last]);
+
+		args = kn_value_as_ast(args[last])->args;
+	}
 }
 
+#ifdef KN_USE_REFCOUNT
+// Whether `function` is `+`, or one of the versions of it that asts are quickened or fused to.
+static inline bool is_add(const struct kn_function *function) {
+	return function == &kn_fn_add || function == &kn_fn_add_integer
+		|| function == &kn_fn_add_immediate;
+}
+
+/*
+ * Evaluates `= variable + variable rhs` when `variable` is a string, storing the result in `ret`.
+ *
+ * Normally the variable's string would have two references when `+` concatenates it (the
+ * variable's and `+`'s own), so it'd always be copied. Instead, if the variable still holds the
+ * string once `rhs` is evaluated, the variable's reference is handed to the concatenation, letting
+ * `kn_string_concat` append to it in place.
+ */
+static bool assign_append(struct kn_variable *variable, kn_value value, kn_value *ret) {
+	if (!kn_value_is_ast(value) || !kn_value_is_string(variable->value))
+		return false;
+
+	const struct kn_ast *ast = kn_value_as_ast(value);
+	if (!is_add(ast->function) || ast->args[0] != kn_value_new(variable))
+		return false;
+
+	// Only allocated strings have meaningful refcounts.
+	if (!(kn_flags(kn_value_as_string(variable->value)) & KN_STRING_FL_STRUCT_ALLOC))
+		return false;
+
+	struct kn_string *lhs = kn_string_clone(kn_value_as_string(variable->value));
+	struct kn_string *rhs = kn_value_to_string(ast->args[1]);
+
+	// Evaluating `rhs` may have reassigned the variable.
+	if (variable->value != kn_value_new(lhs)) {
+		*ret = kn_value_new(kn_string_concat(lhs, rhs));
+		kn_variable_assign(variable, kn_value_clone(*ret));
+		return true;
+	}
+
+	// We hold our own reference, so this can never drop it to zero.
+	assert(lhs->refcount > 1);
+	--lhs->refcount;
+
+	*ret = kn_value_new(kn_string_concat(lhs, rhs));
+	variable->value = kn_value_clone(*ret);
+	return true;
+}
+#endif /* KN_USE_REFCOUNT */
+
 DECLARE_FUNCTION(assign, 2, "=") {
 	struct kn_variable *variable;
 
@@ -577,7 +840,14 @@ DECLARE_FUNCTION(assign, 2, "=") {
 	}
 #endif /* KN_EXT_EQL_INTERPOLATE */
 
-	kn_value ret = kn_value_run(args[1]);
+	kn_value ret;
+
+#ifdef KN_USE_REFCOUNT
+	if (assign_append(variable, args[1], &ret))
+		return ret;
+#endif /* KN_USE_REFCOUNT */
+
+	ret = kn_value_run(args[1]);
 	kn_variable_assign(variable, kn_value_clone(ret));
 	return ret;
 }
@@ -593,6 +863,96 @@ DECLARE_FUNCTION(if, 3, "IF") {
 	return kn_value_run(args[1 + !kn_value_to_boolean(args[0])]);
 }
 
+/*
+ * Superinstructions, which the optimizer fuses common shapes of asts into. Their operands are
+ * variables and literals, whose values are read directly instead of being run (and so cloned and
+ * freed). If the values aren't integers, they finish the way the generic functions would.
+ */
+
+// Returns the value of `arg`, a variable or literal, without running it or taking a reference to
+// it. Undefined variables return `KN_UNDEFINED`, which isn't an integer.
+static inline kn_value peek(kn_value arg) {
+	return kn_value_is_variable(arg) ? kn_value_as_variable(arg)->value : arg;
+}
+
+// `+ variable integer`
+DECLARE_FUNCTION(add_immediate, 2, "+") {
+	kn_value lhs = peek(args[0]);
+
+	if (KN_LIKELY(kn_value_is_integer(lhs)))
+		return kn_value_new(kn_value_as_integer(lhs) + kn_value_as_integer(args[1]));
+
+	return generic_add(args, kn_value_run(args[0]));
+}
+
+// `= variable + variable integer`, eg `= i + i 1`.
+DECLARE_FUNCTION(assign_add_immediate, 2, "=") {
+	const kn_value *add_args = kn_value_as_ast(args[1])->args;
+	kn_value lhs = peek(add_args[0]);
+
+	if (KN_LIKELY(kn_value_is_integer(lhs))) {
+		kn_value sum = kn_value_new(kn_value_as_integer(lhs) + kn_value_as_integer(add_args[1]));
+
+		kn_variable_assign(kn_value_as_variable(args[0]), sum);
+		return sum;
+	}
+
+	return kn_fn_assign.func(args);
+}
+
+// `<` and `>` whose operands are variables and integers, eg `< i n`.
+DECLARE_FUNCTION(lth_slots, 2, "<") {
+	kn_value lhs = peek(args[0]), rhs = peek(args[1]);
+
+	if (KN_LIKELY(kn_value_is_integer(lhs) && kn_value_is_integer(rhs)))
+		return kn_value_new((kn_boolean) (kn_value_as_integer(lhs) < kn_value_as_integer(rhs)));
+
+	return generic_lth(args, kn_value_run(args[0]));
+}
+
+DECLARE_FUNCTION(gth_slots, 2, ">") {
+	kn_value lhs = peek(args[0]), rhs = peek(args[1]);
+
+	if (KN_LIKELY(kn_value_is_integer(lhs) && kn_value_is_integer(rhs)))
+		return kn_value_new((kn_boolean) (kn_value_as_integer(lhs) > kn_value_as_integer(rhs)));
+
+	return generic_gth(args, kn_value_run(args[0]));
+}
+
+// `? variable literal`, eg `? x "a"`.
+DECLARE_FUNCTION(eql_immediate, 2, "?") {
+	kn_value lhs = peek(args[0]);
+
+	if (KN_UNLIKELY(lhs == KN_UNDEFINED))
+		return kn_fn_eql.func(args); // which reports the undefined variable.
+
+	return kn_value_new((kn_boolean) kn_value_equal(lhs, args[1]));
+}
+
+// `WHILE` whose condition is a `kn_fn_lth_slots` or `kn_fn_gth_slots`, which is evaluated in the
+// loop itself, eg `WHILE < i n ...`.
+DECLARE_FUNCTION(while_slots, 2, "WHILE") {
+	const struct kn_ast *condition = kn_value_as_ast(args[0]);
+	bool less = condition->function == &kn_fn_lth_slots;
+
+	while (true) {
+		kn_value lhs = peek(condition->args[0]), rhs = peek(condition->args[1]);
+
+		if (KN_LIKELY(kn_value_is_integer(lhs) && kn_value_is_integer(rhs))) {
+			kn_integer lint = kn_value_as_integer(lhs), rint = kn_value_as_integer(rhs);
+
+			if (less ? !(lint < rint) : !(lint > rint))
+				break;
+		} else if (!kn_value_to_boolean(args[0])) {
+			break;
+		}
+
+		kn_value_free(kn_value_run(args[1]));
+	}
+
+	return KN_NULL;
+}
+
 DECLARE_FUNCTION(get, 3, "GET") {
 	kn_value container = kn_value_run(args[0]);
 	kn_integer start = kn_value_to_integer(args[1]);
@@ -13,6 +13,10 @@
 
 /**
  * The maximum argc for functions. Used for optimizations in some places.
+ *
+ * Sequences (`;` asts) can have more arguments than this, but only asts with at most this many are
+ * cached, and with `KN_USE_GC` every ast has to fit in a cell, so sequences are split into ones of
+ * at most this many statements.
  **/
 #ifndef KN_MAX_ARGC
 # define KN_MAX_ARGC 4
@@ -131,10 +135,58 @@ extern const struct kn_function kn_fn_gth;
 extern const struct kn_function kn_fn_eql;
 extern const struct kn_function kn_fn_and;
 extern const struct kn_function kn_fn_or;
+
+/**
+ * `;`, whose asts are sequences of any number (at least two) of statements, which are run in order.
+ * The parser collects a whole chain of `;`s, like `; a ; b c`, into a single sequence.
+ **/
 extern const struct kn_function kn_fn_then;
+
 extern const struct kn_function kn_fn_assign;
 extern const struct kn_function kn_fn_while;
 
+/**
+ * The versions of `+`, `-`, `*`, `<`, and `>` for integers, which asts are quickened to (ie their
+ * `function` is replaced with) once they've seen two integer operands. They revert the ast to the
+ * generic version if they see anything else.
+ **/
+extern const struct kn_function kn_fn_add_integer;
+extern const struct kn_function kn_fn_sub_integer;
+extern const struct kn_function kn_fn_mul_integer;
+extern const struct kn_function kn_fn_lth_integer;
+extern const struct kn_function kn_fn_gth_integer;
+
+/**
+ * `*`, `/`, and `%` whose right-hand side is a literal power of two (above one), which the optimizer
+ * emits instead of the usual functions. Integers are shifted and masked instead of multiplied and
+ * divided.
+ **/
+extern const struct kn_function kn_fn_mul_pow2;
+extern const struct kn_function kn_fn_div_pow2;
+extern const struct kn_function kn_fn_mod_pow2;
+
+/**
+ * Superinstructions, which the optimizer fuses common shapes of asts into. Their operands are
+ * variables and literals, which they read directly instead of running:
+ * - `kn_fn_add_immediate`: `+ variable integer`
+ * - `kn_fn_assign_add_immediate`: `= variable kn_fn_add_immediate`, eg `= i + i 1`
+ * - `kn_fn_lth_slots`, `kn_fn_gth_slots`: `<` and `>` of variables and integers, eg `< i n`
+ * - `kn_fn_eql_immediate`: `? variable literal`
+ * - `kn_fn_while_slots`: `WHILE` whose condition is `kn_fn_lth_slots` or `kn_fn_gth_slots`
+ **/
+extern const struct kn_function kn_fn_add_immediate;
+extern const struct kn_function kn_fn_assign_add_immediate;
+extern const struct kn_function kn_fn_lth_slots;
+extern const struct kn_function kn_fn_gth_slots;
+extern const struct kn_function kn_fn_eql_immediate;
+extern const struct kn_function kn_fn_while_slots;
+
+/**
+ * `OUTPUT ^ list sep`, which the optimizer emits instead of an `OUTPUT` of a `^`. It writes the
+ * joined list directly, rather than building the joined string just to print it.
+ **/
+extern const struct kn_function kn_fn_output_join;
+
 /**
  *
  * 4.4 Arity 3
@@ -1,88 +1,233 @@
+#if !defined(_DEFAULT_SOURCE) && defined(KN_USE_GC)
+# define _DEFAULT_SOURCE /* for `MAP_ANON` */
+#endif /* !_DEFAULT_SOURCE */
+
 #include "gc.h"
 #ifndef KN_USE_GC
 struct _ignored;
 #else
 #include <stdlib.h>
+#include <string.h>   /* memset */
+#include <setjmp.h>   /* jmp_buf, setjmp */
+#include <stdint.h>   /* uintptr_t */
+#include <assert.h>   /* assert */
 #include "allocator.h"
 #include "shared.h"
+#include "string.h"
+#include "list.h"
+#include "ast.h"
+#include "env.h"
 #include <sys/mman.h>
 
-#define KN_VALUE_SIZE 64 // todo: replace with actual value
-struct anyvalue {
-	KN_HEADER
-	_Alignas(8) char _ignored[KN_VALUE_SIZE];
+/*
+ * Every value in the heap occupies a single cell, which is large enough to hold any of the value
+ * types. Freed cells are threaded together through `next`.
+ */
+union kn_gc_cell {
+	union kn_gc_cell *next;
+	struct kn_string string;
+	struct kn_list list;
+	char ast[sizeof(struct kn_ast) + sizeof(kn_value) * KN_MAX_ARGC];
 };
 
-// KN_STATIC_ASSERT(sizeof(struct anyvalue) == KN_VALUE_SIZE, "size isnt equal");
-static struct anyvalue *heap_start, *heap;
-static unsigned long long heap_size;
+static union kn_gc_cell *heap_start, *heap_next, *heap_end, *free_list;
+static unsigned char *kinds; // the `enum kn_gc_kind` of each cell
+static const void *stack_base;
+
+// The "gray" values, ie ones that have been marked but whose children haven't been yet.
+static union kn_gc_cell **gray;
+static size_t gray_length, gray_capacity;
+
+void kn_gc_init(size_t heap_size) {
+	heap_start = mmap(
+		NULL,
+		heap_size * sizeof(union kn_gc_cell),
+		PROT_READ | PROT_WRITE,
+		MAP_ANON | MAP_PRIVATE,
+		-1,
+		0
+	);
+
+	if (heap_start == MAP_FAILED)
+		kn_die("unable to mmap %zu cells for the heap", heap_size);
+
+	heap_next = heap_start;
+	heap_end = heap_start + heap_size;
+	free_list = NULL;
+	stack_base = NULL;
+
+	// Zero-initialized, as `KN_GC_KIND_FREE` is zero.
+	kinds = calloc(heap_size, sizeof(unsigned char));
+	if (kinds == NULL)
+		kn_die("unable to allocate %zu cell kinds for the heap", heap_size);
+}
 
-void kn_gc_init(unsigned long long heap_size_) {
-	heap_size = heap_size_ * KN_VALUE_SIZE;
+static void sweep(void);
 
-	heap_start = heap = mmap(NULL, heap_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, 0, 0);
+void kn_gc_teardown(void) {
+	// Nothing's marked, so this deallocates every value still in the heap.
+	sweep();
 
-	if (heap == MAP_FAILED)
-		kn_die("unable to mmap %llu bytes for the heap", heap_size);
+	if (munmap(heap_start, (heap_end - heap_start) * sizeof(union kn_gc_cell)))
+		kn_die("unable to un-mmap the heap");
 
-	// kn_log(gc, 1, "initialized gc heap with %lld (0x%llx) bytes of memory", heap_size, heap_size);
+	free(kinds);
+	kn_heap_free(gray);
+	gray = NULL;
+	gray_length = gray_capacity = 0;
 }
 
-void kn_gc_teardown(void) {
-	if (munmap(heap_start, heap_size))
-		kn_die("unable to un-mmap %llu bytes for the heap", heap_size);
+void kn_gc_set_stack_base(const void *base) {
+	if (stack_base == NULL)
+		stack_base = base;
 }
 
-void *kn_gc_malloc_fn(void) {
-	if (KN_UNLIKELY((heap_size / KN_VALUE_SIZE) <= (heap - heap_start))) {
-		kn_gc_start();
+void kn_gc_mark(const void *ptr) {
+	uintptr_t offset = (uintptr_t) ptr - (uintptr_t) heap_start;
 
-		if (KN_UNLIKELY((heap_size / KN_VALUE_SIZE) <= heap - heap_start))
-			kn_die("heap exhausted.");
+	// Also catches pointers below `heap_start`, as they'll wrap around.
+	if ((uintptr_t) (heap_next - heap_start) * sizeof(union kn_gc_cell) <= offset)
+		return;
+
+	// Interior pointers (such as to an embedded string's contents) mark their entire cell.
+	size_t index = offset / sizeof(union kn_gc_cell);
+	if (kinds[index] == KN_GC_KIND_FREE)
+		return;
+
+	union kn_gc_cell *cell = &heap_start[index];
+	if (kn_flags(cell) & KN_GC_FL_MARKED)
+		return;
+
+	kn_flags(cell) |= KN_GC_FL_MARKED;
+
+	if (gray_length == gray_capacity) {
+		gray_capacity = gray_capacity ? gray_capacity * 2 : 256;
+		gray = kn_heap_realloc(gray, sizeof(union kn_gc_cell *) * gray_capacity);
 	}
 
-	while (heap->used) {
-		// printf("skipping in-use address %p", (void *) heap);
-		++heap;
+	gray[gray_length++] = cell;
+}
+
+// Marks everything reachable from the gray values. This uses an explicit stack instead of
+// recursion, as lists can be nested arbitrarily deep.
+static void mark_gray(void) {
+	while (gray_length != 0) {
+		union kn_gc_cell *cell = gray[--gray_length];
+
+		switch (kinds[cell - heap_start]) {
+		case KN_GC_KIND_STRING:
+			kn_string_mark(&cell->string);
+			break;
+
+		case KN_GC_KIND_LIST:
+			kn_list_mark(&cell->list);
+			break;
+
+		case KN_GC_KIND_AST:
+			kn_ast_mark((struct kn_ast *) cell->ast);
+			break;
+
+		default:
+			KN_UNREACHABLE
+		}
 	}
-	heap->used = 1;
-	// printf("found unused heap at address %p", (void *) heap);
-	return heap++;
 }
 
-void kn_gc_start(void) {
-/*#if KN_LOG_GC >= 1
-#define INCR_METRIC(name) do { name++; } while(0);
-	long unsigned unused = 0, marked = 0, freed = 0;
-	kn_log(gc, 1, "starting gc cycle");
-#else
-#define INCR_METRIC(name) do { } while(0)
+// Conservatively marks anything on the stack that looks like it points into the heap. This isn't
+// inlined so that its frame is always younger than every frame that can hold a value.
+static void
+#if KN_HAS_ATTRIBUTE(noinline)
+KN_ATTRIBUTE(noinline)
+#endif
+#if KN_HAS_ATTRIBUTE(no_sanitize_address)
+KN_ATTRIBUTE(no_sanitize_address) // the stack contains asan's redzones
 #endif
+mark_stack(void) {
+	// Spill the callee-saved registers onto the stack so that they're scanned too.
+	jmp_buf registers;
+	(void) setjmp(registers);
+
+	const char *top = (const char *) &registers;
+	const char *bottom = stack_base;
+
+	// Support stacks growing in either direction.
+	if (bottom < top) {
+		const char *tmp = top;
+		top = bottom;
+		bottom = tmp;
+	}
 
-	kn_program_mark(program);
+	for (const char *ptr = top; ptr + sizeof(void *) <= bottom; ptr += sizeof(void *))
+		kn_gc_mark(*(const void *const *) ptr);
+}
 
-	for (struct anyvalue *ptr = heap_start; ptr < heap; ++ptr) {
-		if (!ptr->basic.used) {
-			kn_log(gc, 2, "ptr %p is in unused", heap);
-			INCR_METRIC(unused);
+static void sweep(void) {
+	for (union kn_gc_cell *cell = heap_start; cell < heap_next; ++cell) {
+		unsigned char *kind = &kinds[cell - heap_start];
+
+		if (*kind == KN_GC_KIND_FREE)
 			continue;
-		}
 
-		if (ptr->basic.marked) {
-			kn_log(gc, 2, "ptr %p is in marked", heap);
-			INCR_METRIC(marked);
-			ptr->basic.marked = 0;
+		if (kn_flags(cell) & KN_GC_FL_MARKED) {
+			kn_flags(cell) &= ~KN_GC_FL_MARKED;
 			continue;
 		}
 
-		kn_log(gc, 2, "ptr %p is in unmarked", heap);
-		INCR_METRIC(freed);
+		// The `dealloc` functions only release resources the cell owns, not the cell itself.
+		switch (*kind) {
+		case KN_GC_KIND_STRING:
+			kn_string_dealloc(&cell->string);
+			break;
+
+		case KN_GC_KIND_LIST:
+			kn_list_dealloc(&cell->list);
+			break;
+
+		case KN_GC_KIND_AST:
+			kn_ast_dealloc((struct kn_ast *) cell->ast);
+			break;
+
+		default:
+			KN_UNREACHABLE
+		}
 
-		kn_value_deallocate(kn_value_new_ptr_unchecked((void *) ptr, ptr->basic.genus));
-		ptr->basic.used = 0;
+		*kind = KN_GC_KIND_FREE;
+		cell->next = free_list;
+		free_list = cell;
 	}
+}
+
+void kn_gc_start(void) {
+	assert(stack_base != NULL);
 
-	kn_log(gc, 1, "gc finished: %lu unused, %lu marked, %lu freed", unused, marked, freed);
-	heap = heap_start;*/
+	kn_env_mark_all();
+	mark_stack();
+	mark_gray();
+	sweep();
 }
-#endif
+
+void *kn_gc_malloc_fn(enum kn_gc_kind kind) {
+	union kn_gc_cell *cell;
+
+	if (KN_UNLIKELY(free_list == NULL && heap_next == heap_end)) {
+		kn_gc_start();
+
+		if (KN_UNLIKELY(free_list == NULL))
+			kn_die("heap exhausted.");
+	}
+
+	if (free_list != NULL) {
+		cell = free_list;
+		free_list = cell->next;
+	} else {
+		cell = heap_next++;
+	}
+
+	// Values are zeroed so that marking a partially-initialized one (eg an ast whose arguments are
+	// still being parsed) is harmless.
+	memset(cell, 0, sizeof(union kn_gc_cell));
+	kinds[cell - heap_start] = (unsigned char) kind;
+
+	return cell;
+}
+#endif /* KN_USE_GC */
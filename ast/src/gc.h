@@ -1,10 +1,74 @@
 #ifndef KN_GC_H
 #define KN_GC_H
 
-void kn_gc_init(unsigned long long heap_size);
-void kn_gc_start(void);
+#include <stddef.h> /* size_t */
+
+/**
+ * The amount of cells the garbage collected heap has by default.
+ *
+ * Each cell can hold one string, list, or ast. The heap is reserved up front, but (on most
+ * platforms) only pages that are actually used are ever backed by physical memory.
+ **/
+#ifndef KN_GC_HEAP_SIZE
+# define KN_GC_HEAP_SIZE (1 << 20)
+#endif /* !KN_GC_HEAP_SIZE */
+
+/**
+ * The kinds of values that live within the garbage collected heap.
+ *
+ * The collector records the kind of each cell separately from the value itself, so that it knows
+ * which `kn_xxx_mark` and `kn_xxx_dealloc` functions to call.
+ **/
+enum kn_gc_kind {
+	KN_GC_KIND_FREE,
+	KN_GC_KIND_STRING,
+	KN_GC_KIND_LIST,
+	KN_GC_KIND_AST
+};
+
+/**
+ * The frame address that `kn_gc_set_stack_base` should be given.
+ **/
+#define KN_GC_STACK_BASE() __builtin_frame_address(0)
+
+/**
+ * Reserves a heap of `heap_size` cells; must be called before any other `kn_gc` function.
+ **/
+void kn_gc_init(size_t heap_size);
+
+/**
+ * Releases the heap, deallocating every value that's still within it.
+ **/
 void kn_gc_teardown(void);
-void *kn_gc_malloc_fn(void);
-#define kn_gc_malloc(type) ((type*) kn_gc_malloc_fn())
 
-#endif 
+/**
+ * Sets the oldest stack frame that can contain references to heap values.
+ *
+ * Everything between the current stack pointer and `base` is conservatively scanned for pointers
+ * into the heap when collecting. Only the first call after `kn_gc_init` has any effect, so nested
+ * calls from within an already-registered frame are harmless.
+ **/
+void kn_gc_set_stack_base(const void *base);
+
+/**
+ * Runs a full mark-and-sweep collection.
+ *
+ * This is called automatically when the heap is exhausted, but can also be called manually.
+ **/
+void kn_gc_start(void);
+
+/**
+ * Allocates a zeroed cell of the given kind, collecting garbage if the heap is full.
+ **/
+void *kn_gc_malloc_fn(enum kn_gc_kind kind);
+#define kn_gc_malloc(type, kind) ((type *) kn_gc_malloc_fn(kind))
+
+/**
+ * Marks the value containing `ptr` as live, if `ptr` points into the heap.
+ *
+ * Pointers to values outside of the heap (such as `static` strings) are ignored, as are pointers
+ * to values that have already been marked.
+ **/
+void kn_gc_mark(const void *ptr);
+
+#endif /* !KN_GC_H */
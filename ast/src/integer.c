@@ -2,70 +2,132 @@
 #include "string.h"
 #include "list.h"
 #include "shared.h" /* kn_die */
+#include <string.h> /* memcpy */
+
+#if KN_INTEGER_STRINGS_MAX < KN_INTEGER_STRINGS_MIN
+# error KN_INTEGER_STRINGS_MAX must be at least KN_INTEGER_STRINGS_MIN
+#endif /* KN_INTEGER_STRINGS_MAX < KN_INTEGER_STRINGS_MIN */
+
+#define IN_TABLE(integer) (KN_INTEGER_STRINGS_MIN <= (integer) && (integer) <= KN_INTEGER_STRINGS_MAX)
+#define TABLE_LENGTH (KN_INTEGER_STRINGS_MAX - KN_INTEGER_STRINGS_MIN + 1)
+
+// The two digits of every number below 100, so that digits can be written two at a time.
+static const char digit_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+char *kn_integer_write(kn_integer integer, char *end) {
+	// Negating in unsigned arithmetic means `INT64_MIN` doesn't need a special case.
+	uint64_t magnitude = integer < 0 ? 0 - (uint64_t) integer : (uint64_t) integer;
+
+	while (100 <= magnitude) {
+		const char *pair = &digit_pairs[(magnitude % 100) * 2];
+		magnitude /= 100;
+
+		*--end = pair[1];
+		*--end = pair[0];
+	}
+
+	if (magnitude < 10) {
+		*--end = (char) ('0' + magnitude);
+	} else {
+		*--end = digit_pairs[magnitude * 2 + 1];
+		*--end = digit_pairs[magnitude * 2];
+	}
+
+	if (integer < 0)
+		*--end = '-';
+
+	return end;
+}
 
 struct kn_string *kn_integer_to_string(kn_integer integer) {
-	// pre-known strings.
-	static struct kn_string
-		zero_string = KN_STRING_NEW_EMBED("0"),
-		one_string = KN_STRING_NEW_EMBED("1"),
-		int64_min_string = KN_STRING_NEW_EMBED("-9223372036854775808");
+	// These are zeroed until they're first used, so that the table doesn't take up space in the
+	// executable or in memory until then.
+	static struct kn_string integer_strings[TABLE_LENGTH];
 
-	// Note that `21` is the length of `INT64_MIN`, which is 20 characters long + the trailing `\0`.
-	// So, to be safe, let's just allocate 64.
-	static char buf[64];
-	static struct kn_string integer_string = { .flags = KN_STRING_FL_STATIC };
+	char digits[KN_INTEGER_MAX_LENGTH];
+	char *start;
 
-	if (integer == 0)
-		return &zero_string;
+	if (!IN_TABLE(integer)) {
+		start = kn_integer_write(integer, &digits[sizeof(digits)]);
+		return kn_string_new_borrowed(start, (size_t) (&digits[sizeof(digits)] - start));
+	}
 
-	if (integer == 1)
-		return &one_string;
+	struct kn_string *string = &integer_strings[integer - KN_INTEGER_STRINGS_MIN];
 
-	// We have to predeclare this string because the `integer *= -1` below will be UB.
-	if (KN_UNLIKELY(integer == INT64_MIN))
-		return &int64_min_string; // since inverting the min value doesnt work.
+	if (KN_UNLIKELY(kn_length(string) == 0)) {
+		start = kn_integer_write(integer, &digits[sizeof(digits)]);
 
-	// initialize ptr to the end of the buffer minus one, as the last is
-	// the nul terminator.
-	char *ptr = &buf[sizeof(buf) - 1];
-	bool is_neg = integer < 0;
+		kn_length(string) = (size_t) (&digits[sizeof(digits)] - start);
+		memcpy(string->embed, start, kn_length(string));
+		kn_flags(string) = KN_STRING_FL_EMBED;
 
-	if (is_neg)
-		integer *= -1;
+#ifdef KN_USE_REFCOUNT
+		string->refcount = 1; // held by the table, so it's never deallocated.
+#endif /* KN_USE_REFCOUNT */
 
-	do {
-		*--ptr = '0' + (integer % 10);
-		integer /= 10;
-	} while (integer != 0);
+#ifdef KN_CONTAINER_CACHE
+		string->cached.integer = integer;
+		kn_flags(string) |= KN_STRING_FL_INTEGER;
+#endif /* KN_CONTAINER_CACHE */
+	}
+
+	return kn_string_clone(string);
+}
 
-	if (is_neg)
-		*--ptr = '-';
+// Creates a list of the digits of `integer`. If `is_static` is set, the list is never deallocated
+// and isn't allocated from the gc heap, so it can be kept in the table.
+static struct kn_list *new_digits_list(kn_integer integer, bool is_static) {
+	kn_value digits[KN_INTEGER_MAX_LENGTH];
+	kn_value *start = &digits[KN_INTEGER_MAX_LENGTH];
 
-	integer_string.ptr = ptr;
-	kn_length(&integer_string) = &buf[sizeof(buf) - 1] - ptr;
+	do {
+		*--start = kn_value_new(integer % 10);
+	} while (integer /= 10);
 
-	return &integer_string;
-}
+	size_t length = (size_t) (&digits[KN_INTEGER_MAX_LENGTH] - start);
+	struct kn_list *list;
+
+	if (!is_static) {
+		list = kn_list_alloc(length);
+	} else {
+		list = kn_heap_alloc(struct kn_list);
+		kn_length(list) = length;
+		kn_flags(list) = KN_LIST_FL_STATIC;
 
-struct kn_list *kn_integer_to_list(kn_integer integer) {
-	// Note that `19` is the length of `INT64_MIN`, which is 19 digits and a `-`. So, to be safe,
-	// let's go with 100.
-	static kn_value buf[100];
-	static struct kn_list digits_list = {
 #ifdef KN_USE_REFCOUNT
-		.refcount = 1,
+		list->refcount = 1;
 #endif /* KN_USE_REFCOUNT */
-		.flags = KN_LIST_FL_ALLOC | KN_LIST_FL_STATIC | KN_LIST_FL_INTEGER
-	};
 
-	digits_list.alloc = &buf[sizeof(buf) / sizeof(kn_value)];
-	kn_length(&digits_list) = 0;
+		if (length <= KN_LIST_EMBED_LENGTH) {
+			kn_flags(list) |= KN_LIST_FL_EMBED;
+		} else {
+			kn_flags(list) |= KN_LIST_FL_ALLOC;
+			list->alloc = kn_heap_alloc_array(kn_value, length);
+		}
+	}
 
-	do {
-		*--digits_list.alloc = kn_value_new(integer % 10);
-		++digits_list.length;
-	} while (integer /= 10);
+	kn_value *elements = (kn_flags(list) & KN_LIST_FL_EMBED) ? list->embed : list->alloc;
+	memcpy(elements, start, sizeof(kn_value) * length);
+	kn_flags(list) |= KN_LIST_FL_ONLY_INTEGERS;
 
-	return &digits_list;
+	return list;
 }
 
+struct kn_list *kn_integer_to_list(kn_integer integer) {
+	static struct kn_list *digit_lists[TABLE_LENGTH];
+
+	if (!IN_TABLE(integer))
+		return new_digits_list(integer, false);
+
+	struct kn_list **list = &digit_lists[integer - KN_INTEGER_STRINGS_MIN];
+
+	if (KN_UNLIKELY(*list == NULL))
+		*list = new_digits_list(integer, true);
+
+	return kn_list_clone(*list);
+}
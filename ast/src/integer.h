@@ -22,18 +22,43 @@ struct kn_string;
 struct kn_list;
 
 /**
- * Returns a string representation of `integer`.
- * 
- * For efficiency purposes, this doesn't actually allocate the string (and thus you also don't need
- * to free it). To get an allocated version, use `kn_string_clone_static` on it.
+ * The range of integers whose strings and digit lists are kept in tables by `kn_integer_to_string`
+ * and `kn_integer_to_list`.
+ **/
+#ifndef KN_INTEGER_STRINGS_MIN
+# define KN_INTEGER_STRINGS_MIN (-1024)
+#endif /* !KN_INTEGER_STRINGS_MIN */
+#ifndef KN_INTEGER_STRINGS_MAX
+# define KN_INTEGER_STRINGS_MAX 65535
+#endif /* !KN_INTEGER_STRINGS_MAX */
+
+/**
+ * The most bytes `kn_integer_write` writes: the 19 digits of `INT64_MIN` and its `-`.
+ **/
+#define KN_INTEGER_MAX_LENGTH 20
+
+/**
+ * Writes the decimal representation of `integer` so that it ends right before `end`, returning
+ * where it starts. At most `KN_INTEGER_MAX_LENGTH` bytes before `end` are written.
+ *
+ * This doesn't allocate or use any global state, so it's safe to call from anywhere.
+ **/
+char *kn_integer_write(kn_integer integer, char *end);
+
+/**
+ * Returns a string representation of `integer`, which must be `kn_string_free`d.
+ *
+ * Integers between `KN_INTEGER_STRINGS_MIN` and `KN_INTEGER_STRINGS_MAX` get strings out of a
+ * table, which are filled in the first time they're needed and are never deallocated; others are
+ * looked up in (or added to) the string cache.
  **/
 struct kn_string *kn_integer_to_string(kn_integer integer);
 
 /**
- * Returns a list representation of `integer`.
- * 
- * For efficiency purposes, this doesn't actually allocate the list (and thus you also don't need
- * to free it). To get an allocated version, use `kn_list_clone_integer` on it.
+ * Returns a list of the digits of `integer`, which must be `kn_list_free`d.
+ *
+ * Like `kn_integer_to_string`, integers in the table's range get lists out of a table of their
+ * own; others get newly allocated lists. (Negative integers' digits are all negative.)
  **/
 struct kn_list *kn_integer_to_list(kn_integer integer);
 
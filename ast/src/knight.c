@@ -8,11 +8,51 @@
 #include "shared.h"
 #endif /* !KN_RECKLESS */
 
+#if defined(KN_STRING_CACHE) || defined(KN_AST_CACHE)
+# include <stdlib.h> /* getenv, strtoull */
+# include <errno.h>  /* errno, ERANGE */
+# include <stdint.h> /* SIZE_MAX */
+
+// Reads the size in the environment variable `name`, which must be between `min` and `max`, or
+// returns `fallback` if it's not set. This way, caches can be resized without recompiling.
+static size_t size_from_env(const char *name, size_t fallback, size_t min, size_t max) {
+	const char *size = getenv(name);
+
+	if (size == NULL || *size == '\0')
+		return fallback;
+
+	// `strtoull` would otherwise accept leading whitespace and signs, wrapping `-1` around.
+	if (*size < '0' || '9' < *size)
+		kn_error("invalid %s: '%s'", name, size);
+
+	char *end;
+	errno = 0;
+	unsigned long long amount = strtoull(size, &end, 10);
+
+	if (*end != '\0' || errno == ERANGE || amount < min || max < amount)
+		kn_error("invalid %s: '%s'", name, size);
+
+	return (size_t) amount;
+}
+#endif /* KN_STRING_CACHE || KN_AST_CACHE */
+
 void kn_startup(void) {
 	kn_function_startup();
 
+#ifdef KN_STRING_CACHE
+	kn_string_cache_resize(size_from_env(
+		"KN_STRING_CACHE_SETS", KN_STRING_CACHE_SETS, 1, kn_string_cache_max_sets()
+	));
+#endif /* KN_STRING_CACHE */
+
+#ifdef KN_AST_CACHE
+	kn_ast_cache_set_length(size_from_env(
+		"KN_AST_FREE_CACHE_LEN", KN_AST_FREE_CACHE_LEN, 0, SIZE_MAX
+	));
+#endif /* KN_AST_CACHE */
+
 #ifdef KN_USE_GC
-	kn_gc_init(1000000); // todo: variable size
+	kn_gc_init(KN_GC_HEAP_SIZE);
 #endif /* KN_USE_GC */
 }
 
@@ -23,6 +63,24 @@ void kn_shutdown(void) {
 #ifdef KN_USE_GC
 	kn_gc_teardown();
 #endif /* KN_USE_GC */
+
+#if defined(KN_STATS) && defined(KN_STRING_CACHE)
+	kn_string_cache_dump_stats(stderr);
+#endif /* KN_STATS && KN_STRING_CACHE */
+
+#ifdef KN_STRING_CACHE
+	kn_string_cache_resize(0);
+#endif /* KN_STRING_CACHE */
+
+	kn_string_intern_teardown();
+
+#if defined(KN_STATS) && defined(KN_AST_CACHE)
+	kn_ast_cache_dump_stats(stderr);
+#endif /* KN_STATS && KN_AST_CACHE */
+
+#if defined(KN_STATS) && defined(KN_HEAP_SLAB)
+	kn_heap_dump_stats(stderr);
+#endif /* KN_STATS && KN_HEAP_SLAB */
 }
 
 #ifdef KN_FUZZING
@@ -45,6 +103,11 @@ kn_value kn_play(struct kn_env *env, const char *source, size_t length) {
 		return KN_NULL;
 #endif /* KN_FUZZING */
 
+#ifdef KN_USE_GC
+	// Everything the program references is either in `env` or in a frame younger than this one.
+	kn_gc_set_stack_base(KN_GC_STACK_BASE());
+#endif /* KN_USE_GC */
+
 	struct kn_stream stream = {
 		.source = source,
 		.position = 0,
@@ -1,6 +1,7 @@
 #include "list.h"
 #include "shared.h"
 #include "string.h"
+#include "integer.h"
 #include <string.h>
 #include <assert.h>
 
@@ -13,7 +14,11 @@ struct kn_list kn_list_empty = {
 };
 
 static struct kn_list *alloc_list(size_t length, unsigned char flags) {
+#ifdef KN_USE_GC
+	struct kn_list *list = kn_gc_malloc(struct kn_list, KN_GC_KIND_LIST);
+#else
 	struct kn_list *list = kn_heap_alloc(struct kn_list);
+#endif /* KN_USE_GC */
 
 #ifdef KN_USE_REFCOUNT
 	list->refcount = 1;
@@ -32,9 +37,15 @@ struct kn_list *kn_list_alloc(size_t length) {
 	bool is_embed = KN_LIST_EMBED_LENGTH < length;
 	struct kn_list *list = alloc_list(length, is_embed ? KN_LIST_FL_ALLOC : KN_LIST_FL_EMBED);
 
-	if (is_embed)
+	if (is_embed) {
 		list->alloc = kn_heap_alloc_array(kn_value, length);
 
+#ifdef KN_USE_GC
+		// The list may be marked before the caller's populated it, so don't leave garbage.
+		memset(list->alloc, 0, sizeof(kn_value) * length);
+#endif /* KN_USE_GC */
+	}
+
 	return list;
 }
 
@@ -46,10 +57,13 @@ void kn_list_dealloc(struct kn_list *list) {
 	assert(list->refcount == 0);
 #endif /* KN_USE_REFCOUNT */
 
-	assert(!(kn_flags(list) & KN_LIST_FL_INTEGER)); // `FL_STATIC` covers it.
+#ifdef KN_CONTAINER_CACHE
+	if (kn_flags(list) & KN_LIST_FL_JOINED)
+		kn_string_free(list->cached.joined);
+#endif /* KN_CONTAINER_CACHE */
 
 	// since we're not `KN_LIST_FL_STATIC`, we can switch on them
-	switch (kn_flags(list)) {
+	switch (kn_flags(list) & KN_LIST_FL_TYPE_MASK) {
 	case KN_LIST_FL_CONS:
 		kn_list_free(list->cons.lhs);
 		kn_list_free(list->cons.rhs);
@@ -59,14 +73,20 @@ void kn_list_dealloc(struct kn_list *list) {
 		kn_list_free(list->repeat.list);
 		break;
 
+	case KN_LIST_FL_SLICE:
+		kn_list_free(list->slice.list);
+		break;
+
 	case KN_LIST_FL_EMBED:
-		for (size_t i = 0; i < kn_length(list); ++i)
-			kn_value_free(list->embed[i]);
+		if (!(kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS))
+			for (size_t i = 0; i < kn_length(list); ++i)
+				kn_value_free(list->embed[i]);
 		break;
 
 	case KN_LIST_FL_ALLOC:
-		for (size_t i = 0; i < kn_length(list); ++i)
-			kn_value_free(list->alloc[i]);
+		if (!(kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS))
+			for (size_t i = 0; i < kn_length(list); ++i)
+				kn_value_free(list->alloc[i]);
 
 		kn_heap_free(list->alloc);
 		break;
@@ -75,20 +95,258 @@ void kn_list_dealloc(struct kn_list *list) {
 		KN_UNREACHABLE
 	}
 
+#ifndef KN_USE_GC
 	kn_heap_free(list);
+#endif /* !KN_USE_GC */
 }
 
-struct kn_list *kn_list_clone_integer(struct kn_list *list) {
-	if (!(kn_flags(list) & KN_LIST_FL_INTEGER))
-		return list;
+#ifdef KN_USE_GC
+void kn_list_mark(const struct kn_list *list) {
+# ifdef KN_CONTAINER_CACHE
+	if (kn_flags(list) & KN_LIST_FL_JOINED)
+		kn_gc_mark(list->cached.joined);
+# endif /* KN_CONTAINER_CACHE */
+
+	switch (kn_flags(list) & KN_LIST_FL_TYPE_MASK) {
+	case KN_LIST_FL_CONS:
+		kn_gc_mark(list->cons.lhs);
+		kn_gc_mark(list->cons.rhs);
+		break;
+
+	case KN_LIST_FL_REPEAT:
+		kn_gc_mark(list->repeat.list);
+		break;
+
+	case KN_LIST_FL_SLICE:
+		kn_gc_mark(list->slice.list);
+		break;
+
+	case KN_LIST_FL_EMBED:
+		if (!(kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS))
+			for (size_t i = 0; i < kn_length(list); ++i)
+				kn_value_mark(list->embed[i]);
+		break;
+
+	case KN_LIST_FL_ALLOC:
+		if (!(kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS))
+			for (size_t i = 0; i < kn_length(list); ++i)
+				kn_value_mark(list->alloc[i]);
+		break;
+
+	default:
+		KN_UNREACHABLE
+	}
+}
+#endif /* KN_USE_GC */
+
+void kn_list_iter_init(
+	struct kn_list_iter *iter,
+	const struct kn_list *list,
+	size_t start,
+	size_t length
+) {
+	assert(start + length <= kn_length(list));
 
-	struct kn_list *cloned = kn_list_alloc(kn_length(list));
-	kn_value *ptr = (kn_flags(cloned) & KN_LIST_FL_EMBED)
-			? cloned->embed
-			: cloned->alloc;
+	iter->chunk_length = 0;
+	iter->stack = iter->embed;
+	iter->capacity = KN_LIST_ITER_STACK_LENGTH;
+	iter->depth = 0;
 
-	memcpy(ptr, list->alloc, sizeof(kn_value) * kn_length(list));
-	return cloned;
+	if (length != 0)
+		iter->stack[iter->depth++] = (struct kn_list_iter_frame) { list, start, start + length };
+}
+
+void kn_list_iter_finish(struct kn_list_iter *iter) {
+	if (iter->stack != iter->embed)
+		kn_heap_free(iter->stack);
+}
+
+static void push_frame(struct kn_list_iter *iter, const struct kn_list *list, size_t start, size_t end) {
+	if (KN_UNLIKELY(iter->depth == iter->capacity)) {
+		iter->capacity *= 2;
+
+		if (iter->stack == iter->embed) {
+			iter->stack = kn_heap_alloc_array(struct kn_list_iter_frame, iter->capacity);
+			memcpy(iter->stack, iter->embed, sizeof(iter->embed));
+		} else {
+			iter->stack = kn_heap_realloc(iter->stack, sizeof(struct kn_list_iter_frame) * iter->capacity);
+		}
+	}
+
+	iter->stack[iter->depth++] = (struct kn_list_iter_frame) { list, start, end };
+}
+
+bool kn_list_iter_next_chunk(struct kn_list_iter *iter, const kn_value **chunk, size_t *length) {
+	// Return whatever's left of the current chunk if `kn_list_iter_next` didn't finish it.
+	if (iter->chunk_length != 0) {
+		*chunk = iter->chunk;
+		*length = iter->chunk_length;
+		iter->chunk_length = 0;
+		return true;
+	}
+
+	if (iter->depth == 0)
+		return false;
+
+	struct kn_list_iter_frame frame = iter->stack[--iter->depth];
+	const struct kn_list *list = frame.list;
+	size_t start = frame.start, end = frame.end;
+
+	// Descend until reaching the list holding the first element, remembering the parts of the range
+	// that were skipped over.
+	while (true) {
+		switch (kn_flags(list) & KN_LIST_FL_TYPE_MASK) {
+		case KN_LIST_FL_EMBED:
+			*chunk = list->embed + start;
+			*length = end - start;
+			return true;
+
+		case KN_LIST_FL_ALLOC:
+			*chunk = list->alloc + start;
+			*length = end - start;
+			return true;
+
+		case KN_LIST_FL_CONS: {
+			size_t lhs_length = kn_length(list->cons.lhs);
+
+			if (lhs_length <= start) {
+				start -= lhs_length;
+				end -= lhs_length;
+				list = list->cons.rhs;
+				continue;
+			}
+
+			if (lhs_length < end) {
+				push_frame(iter, list->cons.rhs, 0, end - lhs_length);
+				end = lhs_length;
+			}
+
+			list = list->cons.lhs;
+			continue;
+		}
+
+		case KN_LIST_FL_REPEAT: {
+			size_t inner_length = kn_length(list->repeat.list);
+			size_t offset = start - start % inner_length;
+
+			// Come back to this list for the rest of the repetitions.
+			if (offset + inner_length < end) {
+				push_frame(iter, list, offset + inner_length, end);
+				end = offset + inner_length;
+			}
+
+			start -= offset;
+			end -= offset;
+			list = list->repeat.list;
+			continue;
+		}
+
+		case KN_LIST_FL_SLICE:
+			start += list->slice.start;
+			end += list->slice.start;
+			list = list->slice.list;
+			continue;
+
+		default:
+			KN_UNREACHABLE
+		}
+	}
+}
+
+// Clones `length` elements of `list`, starting at `start`, into `dst`.
+static void copy_elements(kn_value *dst, const struct kn_list *list, size_t start, size_t length) {
+	struct kn_list_iter iter;
+	const kn_value *chunk;
+	size_t chunk_length;
+
+	kn_list_iter_init(&iter, list, start, length);
+
+	while (kn_list_iter_next_chunk(&iter, &chunk, &chunk_length)) {
+		if (kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS) {
+			memcpy(dst, chunk, sizeof(kn_value) * chunk_length);
+			dst += chunk_length;
+			continue;
+		}
+
+		for (size_t i = 0; i < chunk_length; ++i)
+			*dst++ = kn_value_clone(chunk[i]);
+	}
+
+	kn_list_iter_finish(&iter);
+}
+
+static kn_value *elements_of(struct kn_list *list) {
+	assert(kn_flags(list) & (KN_LIST_FL_EMBED | KN_LIST_FL_ALLOC));
+
+	return (kn_flags(list) & KN_LIST_FL_EMBED) ? list->embed : list->alloc;
+}
+
+static bool only_integers(const struct kn_list *lhs, const struct kn_list *rhs) {
+	return kn_flags(lhs) & kn_flags(rhs) & KN_LIST_FL_ONLY_INTEGERS;
+}
+
+#ifndef KN_LIST_MISMATCH_BLOCK
+# define KN_LIST_MISMATCH_BLOCK 8
+#endif /* !KN_LIST_MISMATCH_BLOCK */
+
+// Returns the index of the first element that differs between `lhs` and `rhs`, or `length` if
+// they're identical.
+static size_t mismatch(const kn_value *lhs, const kn_value *rhs, size_t length) {
+	size_t i = 0;
+
+	if (lhs == rhs)
+		return length;
+
+	// Check blocks at a time without branching on each element, which compilers vectorize.
+	for (; i + KN_LIST_MISMATCH_BLOCK <= length; i += KN_LIST_MISMATCH_BLOCK) {
+		kn_value difference = 0;
+
+		for (size_t j = 0; j < KN_LIST_MISMATCH_BLOCK; ++j)
+			difference |= lhs[i + j] ^ rhs[i + j];
+
+		if (difference != 0)
+			break;
+	}
+
+	while (i < length && lhs[i] == rhs[i])
+		++i;
+
+	return i;
+}
+
+// Compares the first `length` elements of lists of only integers, a chunk at a time.
+static kn_integer compare_integers(const struct kn_list *lhs, const struct kn_list *rhs, size_t length) {
+	struct kn_list_iter lhs_iter, rhs_iter;
+	const kn_value *lhs_chunk, *rhs_chunk;
+	size_t lhs_length = 0, rhs_length = 0;
+	kn_integer cmp = 0;
+
+	kn_list_iter_init(&lhs_iter, lhs, 0, length);
+	kn_list_iter_init(&rhs_iter, rhs, 0, length);
+
+	while (cmp == 0 && length != 0) {
+		if (lhs_length == 0)
+			kn_list_iter_next_chunk(&lhs_iter, &lhs_chunk, &lhs_length);
+
+		if (rhs_length == 0)
+			kn_list_iter_next_chunk(&rhs_iter, &rhs_chunk, &rhs_length);
+
+		size_t amount = lhs_length < rhs_length ? lhs_length : rhs_length;
+		size_t index = mismatch(lhs_chunk, rhs_chunk, amount);
+
+		if (index != amount)
+			cmp = kn_value_compare(lhs_chunk[index], rhs_chunk[index]);
+
+		lhs_chunk += amount;
+		rhs_chunk += amount;
+		lhs_length -= amount;
+		rhs_length -= amount;
+		length -= amount;
+	}
+
+	kn_list_iter_finish(&lhs_iter);
+	kn_list_iter_finish(&rhs_iter);
+	return cmp;
 }
 
 bool kn_list_equal(const struct kn_list *lhs, const struct kn_list *rhs) {
@@ -98,11 +356,21 @@ bool kn_list_equal(const struct kn_list *lhs, const struct kn_list *rhs) {
 	if (kn_length(lhs) != kn_length(rhs))
 		return false;
 
-	for (size_t i = 0; i < kn_length(lhs); ++i)
-		if (!kn_value_equal(kn_list_get(lhs, i), kn_list_get(rhs, i)))
-			return false;
+	if (only_integers(lhs, rhs))
+		return compare_integers(lhs, rhs, kn_length(lhs)) == 0;
+
+	struct kn_list_iter lhs_iter, rhs_iter;
+	bool equal = true;
+
+	kn_list_iter_init(&lhs_iter, lhs, 0, kn_length(lhs));
+	kn_list_iter_init(&rhs_iter, rhs, 0, kn_length(rhs));
 
-	return true;
+	for (size_t i = 0; equal && i < kn_length(lhs); ++i)
+		equal = kn_value_equal(kn_list_iter_next(&lhs_iter), kn_list_iter_next(&rhs_iter));
+
+	kn_list_iter_finish(&lhs_iter);
+	kn_list_iter_finish(&rhs_iter);
+	return equal;
 }
 
 kn_integer kn_list_compare(const struct kn_list *lhs, const struct kn_list *rhs) {
@@ -110,34 +378,189 @@ kn_integer kn_list_compare(const struct kn_list *lhs, const struct kn_list *rhs)
 		return 0;
 
 	size_t minlen = kn_length(lhs) < kn_length(rhs) ? kn_length(lhs) : kn_length(rhs);
+	struct kn_list_iter lhs_iter, rhs_iter;
+	kn_integer cmp = 0;
+
+	if (only_integers(lhs, rhs)) {
+		cmp = compare_integers(lhs, rhs, minlen);
+		return cmp != 0 ? cmp : (kn_integer) (kn_length(lhs) - kn_length(rhs));
+	}
+
+	kn_list_iter_init(&lhs_iter, lhs, 0, minlen);
+	kn_list_iter_init(&rhs_iter, rhs, 0, minlen);
+
+	for (size_t i = 0; cmp == 0 && i < minlen; ++i)
+		cmp = kn_value_compare(kn_list_iter_next(&lhs_iter), kn_list_iter_next(&rhs_iter));
+
+	kn_list_iter_finish(&lhs_iter);
+	kn_list_iter_finish(&rhs_iter);
+
+	return cmp != 0 ? cmp : (kn_integer) (kn_length(lhs) - kn_length(rhs));
+}
+
+static bool is_cons(const struct kn_list *list) {
+	return (kn_flags(list) & KN_LIST_FL_TYPE_MASK) == KN_LIST_FL_CONS;
+}
+
+static size_t cons_depth(const struct kn_list *list) {
+	return is_cons(list) ? list->cons.depth : 0;
+}
+
+// Creates a `cons` list out of `lhs` and `rhs`, taking ownership of both.
+static struct kn_list *alloc_cons(struct kn_list *lhs, struct kn_list *rhs) {
+	struct kn_list *cons = alloc_list(
+		kn_length(lhs) + kn_length(rhs),
+		KN_LIST_FL_CONS | (kn_flags(lhs) & kn_flags(rhs) & KN_LIST_FL_ONLY_INTEGERS)
+	);
+	size_t lhs_depth = cons_depth(lhs), rhs_depth = cons_depth(rhs);
+
+	cons->cons.lhs = lhs;
+	cons->cons.rhs = rhs;
+	cons->cons.depth = 1 + (lhs_depth < rhs_depth ? rhs_depth : lhs_depth);
+
+	return cons;
+}
+
+// Releases `cons`, returning owned references to its halves.
+static void split_cons(struct kn_list *cons, struct kn_list **lhs, struct kn_list **rhs) {
+	assert(is_cons(cons));
+
+	*lhs = kn_list_clone(cons->cons.lhs);
+	*rhs = kn_list_clone(cons->cons.rhs);
+	kn_list_free(cons);
+}
+
+// `(a, (b, c))` -> `((a, b), c)`
+static struct kn_list *rotate_left(struct kn_list *cons) {
+	struct kn_list *a, *bc, *b, *c;
 
-	for (size_t i = 0; i < minlen; ++i) {
-		kn_integer cmp = kn_value_compare(kn_list_get(lhs, i), kn_list_get(rhs, i));
+	split_cons(cons, &a, &bc);
+	split_cons(bc, &b, &c);
+	return alloc_cons(alloc_cons(a, b), c);
+}
+
+// `((a, b), c)` -> `(a, (b, c))`
+static struct kn_list *rotate_right(struct kn_list *cons) {
+	struct kn_list *ab, *a, *b, *c;
+
+	split_cons(cons, &ab, &c);
+	split_cons(ab, &a, &b);
+	return alloc_cons(a, alloc_cons(b, c));
+}
+
+/*
+ * `cons` lists are joined the same way AVL trees are: the shallower list is attached to the deeper
+ * one where their depths are within one of each other, and then the path back up is rebalanced.
+ * Lists can be shared, so the lists along that path are copied instead of being modified.
+ */
+
+// `lhs` is more than one level deeper than `rhs`.
+static struct kn_list *join_right(struct kn_list *lhs, struct kn_list *rhs) {
+	struct kn_list *a, *c, *joined;
+
+	split_cons(lhs, &a, &c);
+
+	if (cons_depth(c) <= cons_depth(rhs) + 1) {
+		joined = alloc_cons(c, rhs);
+
+		if (cons_depth(joined) <= cons_depth(a) + 1)
+			return alloc_cons(a, joined);
+
+		return rotate_left(alloc_cons(a, rotate_right(joined)));
+	}
+
+	joined = join_right(c, rhs);
+
+	if (cons_depth(joined) <= cons_depth(a) + 1)
+		return alloc_cons(a, joined);
+
+	return rotate_left(alloc_cons(a, joined));
+}
+
+// `rhs` is more than one level deeper than `lhs`.
+static struct kn_list *join_left(struct kn_list *lhs, struct kn_list *rhs) {
+	struct kn_list *c, *b, *joined;
+
+	split_cons(rhs, &c, &b);
+
+	if (cons_depth(c) <= cons_depth(lhs) + 1) {
+		joined = alloc_cons(lhs, c);
 
-		if (cmp != 0)
-			return cmp;
+		if (cons_depth(joined) <= cons_depth(b) + 1)
+			return alloc_cons(joined, b);
+
+		return rotate_right(alloc_cons(rotate_left(joined), b));
 	}
 
-	return kn_length(lhs) - kn_length(rhs);
+	joined = join_left(lhs, c);
+
+	if (cons_depth(joined) <= cons_depth(b) + 1)
+		return alloc_cons(joined, b);
+
+	return rotate_right(alloc_cons(joined, b));
+}
+
+static struct kn_list *join_lists(struct kn_list *lhs, struct kn_list *rhs) {
+	size_t lhs_depth = cons_depth(lhs), rhs_depth = cons_depth(rhs);
+
+	if (rhs_depth + 1 < lhs_depth)
+		return join_right(lhs, rhs);
+
+	if (lhs_depth + 1 < rhs_depth)
+		return join_left(lhs, rhs);
+
+	return alloc_cons(lhs, rhs);
+}
+
+// Concatenates `lhs` and `rhs` by copying their elements into a new list.
+static struct kn_list *concat_flat(struct kn_list *lhs, struct kn_list *rhs) {
+	struct kn_list *list = kn_list_alloc(kn_length(lhs) + kn_length(rhs));
+
+	copy_elements(elements_of(list), lhs, 0, kn_length(lhs));
+	copy_elements(elements_of(list) + kn_length(lhs), rhs, 0, kn_length(rhs));
+	kn_flags(list) |= kn_flags(lhs) & kn_flags(rhs) & KN_LIST_FL_ONLY_INTEGERS;
+
+	kn_list_free(lhs);
+	kn_list_free(rhs);
+	return list;
+}
+
+// The length of the first or last non-`cons` list within `list`.
+static size_t edge_length(const struct kn_list *list, bool first) {
+	while (is_cons(list))
+		list = first ? list->cons.lhs : list->cons.rhs;
+
+	return kn_length(list);
 }
 
 struct kn_list *kn_list_concat(struct kn_list *lhs, struct kn_list *rhs) {
 	if (kn_length(lhs) == 0) {
 		assert(lhs == &kn_list_empty);
-		return kn_list_clone_integer(rhs);
+		return rhs;
 	}
 
 	if (KN_UNLIKELY(kn_length(rhs) == 0)) {
 		assert(rhs == &kn_list_empty);
-		assert(!(kn_flags(lhs) & KN_LIST_FL_INTEGER));
 		return lhs;
 	}
 
-	struct kn_list *concat = alloc_list(kn_length(lhs) + kn_length(rhs), KN_LIST_FL_CONS);
-	concat->cons.lhs = lhs;
-	concat->cons.rhs = rhs;
+	struct kn_list *first, *second;
+
+	if (kn_length(lhs) + kn_length(rhs) <= KN_LIST_CHUNK_LENGTH)
+		return concat_flat(lhs, rhs);
+
+	// Append short lists onto the last chunk of `lhs`, and prepend them onto the first of `rhs`.
+	if (!is_cons(rhs) && is_cons(lhs) && edge_length(lhs, false) + kn_length(rhs) <= KN_LIST_CHUNK_LENGTH) {
+		split_cons(lhs, &first, &second);
+		return join_lists(first, kn_list_concat(second, rhs));
+	}
+
+	if (!is_cons(lhs) && is_cons(rhs) && kn_length(lhs) + edge_length(rhs, true) <= KN_LIST_CHUNK_LENGTH) {
+		split_cons(rhs, &first, &second);
+		return join_lists(kn_list_concat(lhs, first), second);
+	}
 
-	return concat;
+	return join_lists(lhs, rhs);
 }
 
 struct kn_list *kn_list_repeat(struct kn_list *list, size_t amount) {
@@ -155,13 +578,126 @@ struct kn_list *kn_list_repeat(struct kn_list *list, size_t amount) {
 		return list;
 
 
-	struct kn_list *repetition = alloc_list(kn_length(list) * amount, KN_LIST_FL_REPEAT);
+	struct kn_list *repetition = alloc_list(
+		kn_length(list) * amount,
+		KN_LIST_FL_REPEAT | (kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS)
+	);
 	repetition->repeat.list = list;
 	repetition->repeat.amount = amount;
 
 	return repetition;
 }
 
+// How much of a joined list is buffered before it's written to a file.
+#define JOIN_CHUNK_LENGTH 4096
+
+// The most that `kn_list_join` allocates before it knows the elements need more.
+#define JOIN_GUESS_LIMIT (16 * 1024 * 1024)
+
+// Where the pieces of a joined list are written: either a buffer that grows to hold all of them,
+// or a chunk that's written to `file` whenever it fills up. When writing to a file, the chunk always
+// keeps the last byte written, so that it can be held back at the end.
+struct join_sink {
+	char *buffer;
+	size_t length, capacity;
+	FILE *file;
+};
+
+static void KN_COLD sink_make_room(struct join_sink *sink, const char **data, size_t *length) {
+	if (sink->file == NULL) {
+		sink->capacity = sink->capacity * 2 + *length;
+		sink->buffer = kn_heap_realloc(sink->buffer, sink->capacity);
+		return;
+	}
+
+	if (sink->length != 0) {
+		fwrite(sink->buffer, sizeof(char), sink->length - 1, sink->file);
+		sink->buffer[0] = sink->buffer[sink->length - 1];
+		sink->length = 1;
+	}
+
+	// Pieces too large for the chunk are written directly, other than their last byte.
+	if (sink->capacity - sink->length < *length) {
+		if (sink->length != 0)
+			fwrite(sink->buffer, sizeof(char), 1, sink->file);
+
+		fwrite(*data, sizeof(char), *length - 1, sink->file);
+		*data += *length - 1;
+		*length = 1;
+		sink->length = 0;
+	}
+}
+
+static inline void sink_write(struct join_sink *sink, const char *data, size_t length) {
+	if (KN_UNLIKELY(sink->capacity - sink->length < length))
+		sink_make_room(sink, &data, &length);
+
+	memcpy(sink->buffer + sink->length, data, length);
+	sink->length += length;
+}
+
+static void write_joined(
+	struct join_sink *sink,
+	const struct kn_list *list,
+	const char *sep,
+	size_t sep_length
+);
+
+// Writes `value` as a string, without converting it into one when possible.
+static void write_value(struct join_sink *sink, kn_value value) {
+	if (kn_value_is_integer(value)) {
+		char digits[KN_INTEGER_MAX_LENGTH];
+		char *end = &digits[sizeof(digits)];
+		char *start = kn_integer_write(kn_value_as_integer(value), end);
+
+		sink_write(sink, start, (size_t) (end - start));
+		return;
+	}
+
+	if (kn_value_is_string(value)) {
+		struct kn_string *string = kn_value_as_string(value);
+		sink_write(sink, kn_string_deref(string), kn_length(string));
+		return;
+	}
+
+	if (kn_value_is_list(value)) {
+		const struct kn_list *list = kn_value_as_list(value);
+
+#ifdef KN_CONTAINER_CACHE
+		if (kn_flags(list) & KN_LIST_FL_JOINED) {
+			sink_write(sink, kn_string_deref(list->cached.joined), kn_length(list->cached.joined));
+			return;
+		}
+#endif /* KN_CONTAINER_CACHE */
+
+		write_joined(sink, list, "\n", 1);
+		return;
+	}
+
+	struct kn_string *string = kn_value_to_string(value);
+	sink_write(sink, kn_string_deref(string), kn_length(string));
+	kn_string_free(string);
+}
+
+static void write_joined(
+	struct join_sink *sink,
+	const struct kn_list *list,
+	const char *sep,
+	size_t sep_length
+) {
+	struct kn_list_iter iter;
+	kn_list_iter_init(&iter, list, 0, kn_length(list));
+
+	for (size_t i = 0; i < kn_length(list); ++i) {
+		if (i != 0)
+			sink_write(sink, sep, sep_length);
+
+		write_value(sink, kn_list_iter_next(&iter));
+	}
+
+	kn_list_iter_finish(&iter);
+}
+
 struct kn_string *kn_list_join(const struct kn_list *list, const struct kn_string *sep) {
 	if (kn_length(list) == 0) {
 		assert(list == &kn_list_empty);
@@ -171,32 +707,121 @@ struct kn_string *kn_list_join(const struct kn_list *list, const struct kn_strin
 	if (kn_length(list) == 1)
 		return kn_value_to_string(kn_list_get(list, 0));
 
-	size_t len = 0, cap = 64;
-	char *joined = kn_heap_malloc(cap);
-	
-	for (size_t i = 0; i < kn_length(list); ++i) {
-		if (i != 0) {
-			if (cap <= kn_length(sep) + len)
-				joined = kn_heap_realloc(joined, cap = cap * 2 + kn_length(sep));
+	// Start with room for short elements, which is usually enough that the buffer never grows.
+	// (Very long lists, which are usually repetitions, start smaller so nothing's overallocated.)
+	size_t guess = kn_length(list) * (kn_length(sep) + 8);
+	struct join_sink sink = { .capacity = guess < JOIN_GUESS_LIMIT ? guess : JOIN_GUESS_LIMIT };
+	sink.buffer = kn_heap_malloc(sink.capacity);
+
+	write_joined(&sink, list, kn_string_deref(sep), kn_length(sep));
+	return kn_string_new_owned(sink.buffer, sink.length);
+}
+
+int kn_list_join_write(const struct kn_list *list, const struct kn_string *sep, FILE *file) {
+	char chunk[JOIN_CHUNK_LENGTH];
+	struct join_sink sink = { .buffer = chunk, .capacity = sizeof(chunk), .file = file };
 
-			memcpy(joined + len, kn_string_deref(sep), kn_length(sep));
-			len += kn_length(sep);
+	write_joined(&sink, list, kn_string_deref(sep), kn_length(sep));
+
+	if (sink.length == 0)
+		return EOF;
+
+	fwrite(chunk, sizeof(char), sink.length - 1, file);
+	return (unsigned char) chunk[sink.length - 1];
+}
+
+struct kn_string *kn_list_to_string(const struct kn_list *list) {
+	static struct kn_string newline = KN_STRING_NEW_EMBED("\n");
+
+#ifdef KN_CONTAINER_CACHE
+	if (kn_flags(list) & KN_LIST_FL_JOINED)
+		return kn_string_clone(list->cached.joined);
+#endif /* KN_CONTAINER_CACHE */
+
+	struct kn_string *joined = kn_list_join(list, &newline);
+
+#ifdef KN_CONTAINER_CACHE
+	// Static lists are never freed, so they'd never release what they remember.
+	if (!(kn_flags(list) & KN_LIST_FL_STATIC)) {
+		KN_CLANG_IGNORE("-Wcast-qual", ((struct kn_list *) list)->cached.joined = kn_string_clone(joined);)
+		kn_flags(list) |= KN_LIST_FL_JOINED;
+	}
+#endif /* KN_CONTAINER_CACHE */
+
+	return joined;
+}
+
+// Replaces `*list` with `child`, which is an element of it, and returns `child`.
+static struct kn_list *descend(struct kn_list **list, struct kn_list *child) {
+	child = kn_list_clone(child);
+	kn_list_free(*list);
+	return *list = child;
+}
+
+// Creates a slice of `list`, taking ownership of it.
+static struct kn_list *slice_list(struct kn_list *list, size_t start, size_t length) {
+	// Find the smallest list containing the entire slice, so that getting elements from the
+	// slice doesn't have to go through other slices, or through `cons` or `repeat` lists when
+	// they can be avoided.
+	while (true) {
+		switch (kn_flags(list) & KN_LIST_FL_TYPE_MASK) {
+		case KN_LIST_FL_SLICE:
+			start += list->slice.start;
+			descend(&list, list->slice.list);
+			continue;
+
+		case KN_LIST_FL_CONS: {
+			size_t lhs_length = kn_length(list->cons.lhs);
+
+			if (start + length <= lhs_length) {
+				descend(&list, list->cons.lhs);
+				continue;
+			}
+
+			if (lhs_length <= start) {
+				start -= lhs_length;
+				descend(&list, list->cons.rhs);
+				continue;
+			}
+
+			// Slices of `cons` lists would pile up on top of each other as a list is repeatedly
+			// updated, so they're split and rejoined instead, which keeps them balanced.
+			struct kn_list *lhs, *rhs;
+			split_cons(list, &lhs, &rhs);
+
+			return kn_list_concat(
+				kn_list_get_sublist(lhs, start, lhs_length - start),
+				kn_list_get_sublist(rhs, 0, start + length - lhs_length)
+			);
 		}
 
-		struct kn_string *string = kn_value_to_string(kn_list_get(list, i));
-		if (cap <= kn_length(string) + len)
-			joined = kn_heap_realloc(joined, cap = cap * 2 + kn_length(string));
+		case KN_LIST_FL_REPEAT: {
+			size_t inner_length = kn_length(list->repeat.list);
 
-		memcpy(joined + len, kn_string_deref(string), kn_length(string));
-		len += kn_length(string);
+			if (start / inner_length == (start + length - 1) / inner_length) {
+				start %= inner_length;
+				descend(&list, list->repeat.list);
+				continue;
+			}
 
-		kn_string_free(string);
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		break;
 	}
 
-	joined = kn_heap_realloc(joined, len + 1);
-	joined[len] = '\0';
+	if (start == 0 && length == kn_length(list))
+		return list;
+
+	struct kn_list *slice = alloc_list(length, KN_LIST_FL_SLICE | (kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS));
+	slice->slice.list = list;
+	slice->slice.start = start;
 
-	return kn_string_new_owned(joined, len);
+	return slice;
 }
 
 struct kn_list *kn_list_get_sublist(struct kn_list *list, size_t start, size_t length) {
@@ -210,10 +835,13 @@ struct kn_list *kn_list_get_sublist(struct kn_list *list, size_t start, size_t l
 	if (KN_UNLIKELY(start == 0 && length == kn_length(list)))
 		return list;
 
-	struct kn_list *sublist = kn_list_alloc(length);
+	// Short sublists are just embedded.
+	if (KN_LIST_EMBED_LENGTH < length)
+		return slice_list(list, start, length);
 
-	for (size_t i = 0; i < length; ++i)
-		kn_list_set(sublist, i, kn_value_clone(kn_list_get(list, i + start)));
+	struct kn_list *sublist = kn_list_alloc(length);
+	copy_elements(elements_of(sublist), list, start, length);
+	kn_flags(sublist) |= kn_flags(list) & KN_LIST_FL_ONLY_INTEGERS;
 
 	kn_list_free(list);
 	return sublist;
@@ -232,30 +860,27 @@ struct kn_list *kn_list_set_sublist(
 		return replacement;
 	}
 
-	struct kn_list *replaced = kn_list_alloc(kn_length(list) - length + kn_length(replacement));
-
-	size_t i = 0;
-	for (; i < start; ++i)
-		kn_list_set(replaced, i, kn_value_clone(kn_list_get(list, i)));
-
-	for (size_t j = 0; j < kn_length(replacement); ++j, ++i)
-		kn_list_set(replaced, i, kn_value_clone(kn_list_get(replacement, j)));
-
-	for (size_t j = start + length; j < kn_length(list); ++j, ++i)
-		kn_list_set(replaced, i, kn_value_clone(kn_list_get(list, j)));
+	// The result shares everything but `replacement` with `list`.
+	size_t end = start + length;
+	struct kn_list *prefix = kn_list_get_sublist(kn_list_clone(list), 0, start);
+	struct kn_list *suffix = kn_list_get_sublist(list, end, kn_length(list) - end);
 
-	return replaced;
+	return kn_list_concat(kn_list_concat(prefix, replacement), suffix);
 }
 
 void kn_list_dump(const struct kn_list *list, FILE *out) {
+	struct kn_list_iter iter;
+	kn_list_iter_init(&iter, list, 0, kn_length(list));
+
 	fputc('[', out);
 
 	for (size_t i = 0; i < kn_length(list); ++i) {
 		if (i != 0)
 			fputs(", ", out);
 
-		kn_value_dump(kn_list_get(list, i), out);
+		kn_value_dump(kn_list_iter_next(&iter), out);
 	}
 
 	fputc(']', out);
+	kn_list_iter_finish(&iter);
 }
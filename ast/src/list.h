@@ -18,10 +18,28 @@
 #define KN_LIST_EMBED_LENGTH \
 	(KN_LIST_EMBED_PADDING + (sizeof(struct kn_list *) * 2 / sizeof(kn_value)))
 
+/**
+ * Lists at most this long are concatenated by copying their elements, as are short lists onto the
+ * ends of `cons` lists. This keeps lists built an element at a time from having a `cons` per
+ * element.
+ **/
+#ifndef KN_LIST_CHUNK_LENGTH
+# define KN_LIST_CHUNK_LENGTH 32
+#endif /* !KN_LIST_CHUNK_LENGTH */
+
+/**
+ * How many parts of a list an iterator can remember it has yet to visit before it has to allocate
+ * memory to remember more.
+ **/
+#ifndef KN_LIST_ITER_STACK_LENGTH
+# define KN_LIST_ITER_STACK_LENGTH 32
+#endif /* !KN_LIST_ITER_STACK_LENGTH */
+
 /**
  * Flags denoting how the list works.
  * 
- * Other than `KN_LIST_FL_STATIC` (and `KN_LIST_FL_INTEGER`), flags aren't composable.
+ * Only the flags within `KN_LIST_FL_TYPE_MASK`, which say which variant the list is, are mutually
+ * exclusive; the rest (eg `KN_LIST_FL_STATIC`) are ORed onto them.
  */
 enum {
 	/**
@@ -42,7 +60,8 @@ enum {
 	 * The list's the concatenation of two other lists (via the `kn_list_concat` function).
 	 * 
 	 * This corresponds to the `cons` variant. (`cons` is a function that originally came from
-	 * lisp and means concatenating two lists together)
+	 * lisp and means concatenating two lists together) `cons` lists are kept balanced, so getting
+	 * an element from one takes logarithmic time.
 	 **/
 	KN_LIST_FL_CONS = (1 << 2),
 
@@ -53,26 +72,41 @@ enum {
 	 **/
 	KN_LIST_FL_REPEAT = (1 << 3),
 
+	/**
+	 * The list's a contiguous part of another list (via the `kn_list_get_sublist` function).
+	 * 
+	 * This corresponds to the `slice` variant.
+	 **/
+	KN_LIST_FL_SLICE = (1 << 4),
+
 	/**
 	 * A mask to get all the "data representation" flags.
 	 **/
-	KN_LIST_FL_TYPE_MASK = (1 << 4) - 1,
+	KN_LIST_FL_TYPE_MASK = (1 << 5) - 1,
 
 	/**
 	 * Indicates that a list is statically allocated, and should not be freed when
 	 * `kn_list_dealloc` is called.
 	 **/
-	KN_LIST_FL_STATIC = (1 << 4),
+	KN_LIST_FL_STATIC = (1 << 5),
 
 	/**
-	 * A special flag that's only ever used by the `kn_integer_to_list`. 
-	 * 
-	 * This is used to avoid allocating new lists each time an integer is converted to a list. To
-	 * get an allocated version of this, use `kn_list_clone_integer`.
+	 * Indicates that every element of the list is an integer.
 	 * 
-	 * Note this flag is only ever used in conjunction with `KN_LIST_FL_STATIC`.
+	 * This is set when such lists are created, and is kept by concatenating, repeating, or taking
+	 * sublists of them. Since integers don't need to be cloned or freed, and equal integers are
+	 * always identical `kn_value`s, these lists can be copied and compared in bulk.
+	 **/
+	KN_LIST_FL_ONLY_INTEGERS = (1 << 6)
+
+#ifdef KN_CONTAINER_CACHE
+	/**
+	 * Indicates that `cached.joined` holds a reference to what the list converts to as a string.
+	 *
+	 * Static lists never set this, as they'd never release the string.
 	 **/
-	KN_LIST_FL_INTEGER = (1 << 5)
+	, KN_LIST_FL_JOINED = (1 << 7)
+#endif /* KN_CONTAINER_CACHE */
 
 #ifdef KN_USE_GC
 	, KN_LIST_FL_MARK = KN_GC_FL_MARKED
@@ -99,6 +133,13 @@ struct kn_list {
 	 **/
 	KN_CONTAINER
 
+	/**
+	 * What the list converts to as a string, when `KN_LIST_FL_JOINED` is set.
+	 **/
+	KN_CONTAINER_CACHED({
+		struct kn_string *joined;
+	})
+
 	union {
 		/**
 		 * Elements are embedded directly within a list's body. Corresponds to `KN_LIST_FL_EMBED`.
@@ -113,9 +154,13 @@ struct kn_list {
 
 		/**
 		 * Elements are first from `lhs` then to `rhs`. Corresponds to `KN_LIST_FL_CONS`.
+		 * 
+		 * `depth` is how many `cons` lists deep the tree below this list is. The depths of `lhs`
+		 * and `rhs` never differ by more than one.
 		 **/
 		struct {
 			struct kn_list *lhs, *rhs;
+			size_t depth;
 		} cons;
 
 		/**
@@ -127,6 +172,16 @@ struct kn_list {
 			struct kn_list *list;
 			size_t amount;
 		} repeat;
+
+		/**
+		 * Elements are `list`'s, starting from `start`. Corresponds to `KN_LIST_FL_SLICE`.
+		 * 
+		 * Note that `list` is never a slice itself.
+		 **/
+		struct {
+			struct kn_list *list;
+			size_t start;
+		} slice;
 	};
 };
 
@@ -148,9 +203,18 @@ struct kn_list *kn_list_alloc(size_t length);
 /**
  * Deallocates the memory associated with `string`; should only be called with
  * a string with a zero refcount.
+ *
+ * When using `KN_USE_GC`, this is only called by the collector, and doesn't free the struct itself.
  **/
 void kn_list_dealloc(struct kn_list *list);
 
+#ifdef KN_USE_GC
+/**
+ * Marks all the elements of `list` as reachable.
+ **/
+void kn_list_mark(const struct kn_list *list);
+#endif /* KN_USE_GC */
+
 /**
  * Duplicates this list, returning another copy of it.
  *
@@ -165,14 +229,6 @@ static inline struct kn_list *kn_list_clone(struct kn_list *list) {
 	return list;
 }
 
-/**
- * A no-op for normal lists, but duplicates `list` if it's an integer list.
- * 
- * Since integer lists are globally modifiable, if there's any possibility that a list's contents
- * will be overwritten, call this function.
- **/
-struct kn_list *kn_list_clone_integer(struct kn_list *list);
-
 /**
  * Indicates that the caller is done using this list.
  *
@@ -202,24 +258,102 @@ static inline void kn_list_free(struct kn_list *list) {
 static inline kn_value kn_list_get(const struct kn_list *list, size_t index) {
 	assert(index < kn_length(list));
 
-	switch (kn_flags(list) & KN_LIST_FL_TYPE_MASK) {
-	case KN_LIST_FL_EMBED:
-		return list->embed[index];
+	while (true) {
+		switch (kn_flags(list) & KN_LIST_FL_TYPE_MASK) {
+		case KN_LIST_FL_EMBED:
+			return list->embed[index];
+
+		case KN_LIST_FL_ALLOC:
+			return list->alloc[index];
+
+		case KN_LIST_FL_CONS:
+			if (kn_length(list->cons.lhs) <= index) {
+				index -= kn_length(list->cons.lhs);
+				list = list->cons.rhs;
+			} else {
+				list = list->cons.lhs;
+			}
+			continue;
+
+		case KN_LIST_FL_REPEAT:
+			index %= kn_length(list->repeat.list);
+			list = list->repeat.list;
+			continue;
+
+		case KN_LIST_FL_SLICE:
+			index += list->slice.start;
+			list = list->slice.list;
+			continue;
+
+		default:
+			KN_UNREACHABLE
+		}
+	}
+}
+
+/**
+ * A cursor over the elements of a list (or a range of one), in order.
+ * 
+ * Using `kn_list_get` for each element walks down from the top of the list every time. Instead,
+ * iterators keep an explicit stack of the parts of the list they have yet to visit, so yielding
+ * each element takes amortized constant time. Elements are yielded in contiguous chunks, which
+ * can be used directly via `kn_list_iter_next_chunk`.
+ * 
+ * Iterators don't own the list they're iterating over, can't be copied, and must be passed to
+ * `kn_list_iter_finish` when they're no longer needed.
+ **/
+struct kn_list_iter {
+	/**
+	 * The elements left in the current chunk.
+	 **/
+	const kn_value *chunk;
+	size_t chunk_length;
+
+	/**
+	 * The ranges of lists left to visit after the current chunk; the next one is on top. This
+	 * points to `embed` until more than `KN_LIST_ITER_STACK_LENGTH` ranges are needed.
+	 **/
+	struct kn_list_iter_frame {
+		const struct kn_list *list;
+		size_t start, end;
+	} *stack, embed[KN_LIST_ITER_STACK_LENGTH];
+
+	size_t depth, capacity;
+};
+
+/**
+ * Starts iterating over the `length` elements of `list` starting at `start`.
+ **/
+void kn_list_iter_init(
+	struct kn_list_iter *iter,
+	const struct kn_list *list,
+	size_t start,
+	size_t length
+);
 
-	case KN_LIST_FL_ALLOC:
-		return list->alloc[index];
+/**
+ * Gets the next contiguous chunk of elements, returning false if there are none left.
+ **/
+bool kn_list_iter_next_chunk(struct kn_list_iter *iter, const kn_value **chunk, size_t *length);
 
-	case KN_LIST_FL_CONS:
-		if (index < kn_length(list->cons.lhs))
-			return kn_list_get(list->cons.lhs, index);
-		return kn_list_get(list->cons.rhs, index - kn_length(list->cons.lhs));
+/**
+ * Releases any memory `iter` allocated.
+ **/
+void kn_list_iter_finish(struct kn_list_iter *iter);
 
-	case KN_LIST_FL_REPEAT:
-		return kn_list_get(list->repeat.list, index % kn_length(list->repeat.list));
+/**
+ * Gets the next element; there must be one left.
+ **/
+static inline kn_value kn_list_iter_next(struct kn_list_iter *iter) {
+	if (KN_UNLIKELY(iter->chunk_length == 0)) {
+		bool has_next = kn_list_iter_next_chunk(iter, &iter->chunk, &iter->chunk_length);
 
-	default:
-		KN_UNREACHABLE
+		assert(has_next);
+		(void) has_next;
 	}
+
+	--iter->chunk_length;
+	return *iter->chunk++;
 }
 
 /**
@@ -236,6 +370,14 @@ void kn_list_dump(const struct kn_list *list, FILE *out);
 
 struct kn_string *kn_list_join(const struct kn_list *list, const struct kn_string *sep);
 
+/**
+ * Writes the elements of `list`, joined by `sep`, to `file` without building the joined string.
+ *
+ * The last byte isn't written; it's returned instead (or `EOF` if nothing would be written), so
+ * that the caller can decide what to do with it.
+ **/
+int kn_list_join_write(const struct kn_list *list, const struct kn_string *sep, FILE *file);
+
 struct kn_list *kn_list_concat(struct kn_list *lhs, struct kn_list *rhs);
 struct kn_list *kn_list_repeat(struct kn_list *list, size_t amount);
 bool kn_list_equal(const struct kn_list *lhs, const struct kn_list *rhs);
@@ -256,10 +398,12 @@ static inline kn_integer kn_list_to_integer(const struct kn_list *list) {
 	return (kn_integer) kn_length(list);
 }
 
-static inline struct kn_string *kn_list_to_string(const struct kn_list *list) {
-	static struct kn_string newline = KN_STRING_NEW_EMBED("\n");
-	return kn_list_join(list, &newline);
-}
+/**
+ * Converts a list to a string by joining its elements with newlines.
+ *
+ * When using `KN_CONTAINER_CACHE`, the result is kept in the list, so converting it again is free.
+ **/
+struct kn_string *kn_list_to_string(const struct kn_list *list);
 
 kn_integer kn_list_compare(const struct kn_list *lhs, const struct kn_list *rhs);
 
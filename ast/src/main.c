@@ -1,43 +1,36 @@
+#if !defined(KN_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+# define MAP_SCRIPTS
+# ifndef _DEFAULT_SOURCE
+#  define _DEFAULT_SOURCE /* for `madvise` */
+# endif /* !_DEFAULT_SOURCE */
+#endif /* !KN_NO_MMAP && (__unix__ || __APPLE__) */
+
 #ifdef KN_FUZZING
 struct _ignored;
 #else
 #include "knight.h" /* kn_startup, kn_play, kn_value_free, kn_shutdown */
 #include "shared.h" /* kn_die, kn_heap_malloc, kn_heap_realloc */
 #include "env.h"
+#include "string.h" /* kn_string_intern_borrow */
 
 #include <stdlib.h> /* free, NULL, size_t */
+#include <stdbool.h> /* bool, true, false */
 #include <stdio.h>  /* FILE, fopen, feof, fread, fclose, perror, EOF */
-#include <string.h> /* strcmp, strerror */
+#include <string.h> /* strcmp, strlen, strerror */
 
 #ifndef KN_RECKLESS
 # include <errno.h> /* errno */
 #endif /* !KN_RECKLESS */
 
-/**
- * The amount of buckets that the `kn_env_map` will have.
- *
- * The greater the number, the fewer cache collisions, but the more memory used.
- **/
-#ifndef KN_ENV_NBUCKETS
-# define KN_ENV_NBUCKETS 65536
-#endif /* !KN_ENV_NBUCKETS */
-
-/**
- * The capacity of each bucket.
- *
- * Once this many variables are in a single bucket, the program will have to
- * reallocate those buckets.
- **/
-#ifndef KN_ENV_CAPACITY
-# define KN_ENV_CAPACITY 256
-#endif /* !KN_ENV_CAPACITY */
-
-#if KN_ENV_CAPACITY == 0
-# error env capacity must be at least 1
-#endif /* KN_ENV_CAPACITY == 0 */
-
-
-static char *read_file(const char *filename) {
+#ifdef MAP_SCRIPTS
+# include <fcntl.h>    /* open, O_RDONLY */
+# include <unistd.h>   /* close */
+# include <sys/mman.h> /* mmap, madvise, munmap */
+# include <sys/stat.h> /* fstat, S_ISREG */
+#endif /* MAP_SCRIPTS */
+
+
+static char *read_file(const char *filename, size_t *length_out) {
 	FILE *file = fopen(filename, "r");
 
 	if (file == NULL) {
@@ -73,13 +66,42 @@ static char *read_file(const char *filename) {
 		kn_error("couldn't close input file: %s", strerror(errno));
 	}
 
-	contents = kn_heap_realloc(contents, length + 1);
-	contents[length] = '\0';
+	*length_out = length;
 	return contents;
 }
 
+#ifdef MAP_SCRIPTS
+// Maps the file into memory read-only, so that it needn't be copied and string literals and
+// variable names can point into it. Returns `NULL` if it can't be mapped (eg if it's a pipe or is
+// empty), in which case it should be read instead.
+static char *map_file(const char *filename, size_t *length_out) {
+	int fd = open(filename, O_RDONLY);
+	struct stat info;
+	void *contents = MAP_FAILED;
+
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && 0 < info.st_size) {
+		contents = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		*length_out = (size_t) info.st_size;
+	}
+
+	close(fd);
+
+	if (contents == MAP_FAILED)
+		return NULL;
+
+	// It's just a hint, so it doesn't matter if it fails.
+	(void) madvise(contents, *length_out, MADV_SEQUENTIAL);
+	return contents;
+}
+#endif /* MAP_SCRIPTS */
+
 int main(int argc, char **argv) {
 	char *str;
+	size_t length;
+	bool mapped = false;
 
 	if (argc != 3 || (!strcmp(argv[1], "-e") && !strcmp(argv[1], "-f")))
 		goto usage;
@@ -88,10 +110,17 @@ int main(int argc, char **argv) {
 	switch (argv[1][1]) {
 	case 'e':
 		str = argv[2];
+		length = strlen(str);
 		break;
 
 	case 'f':
-		str = read_file(argv[2]);
+#ifdef MAP_SCRIPTS
+		if ((str = map_file(argv[2], &length)) != NULL) {
+			mapped = true;
+			break;
+		}
+#endif /* MAP_SCRIPTS */
+		str = read_file(argv[2], &length);
 		break;
 
 	default:
@@ -101,15 +130,24 @@ int main(int argc, char **argv) {
 	}
 
 	kn_startup();
-	struct kn_env *env = kn_env_create(KN_ENV_CAPACITY, KN_ENV_NBUCKETS);
+	struct kn_env *env = kn_env_create();
+
+	// The mapping outlives every interned string, so they can borrow from it.
+	if (mapped)
+		kn_string_intern_borrow(str, length);
 
 #ifdef KN_RECKLESS
-	kn_play(env, str, strlen(str));
+	kn_play(env, str, length);
 #else
-	kn_value_free(kn_play(env, str, strlen(str)));
+	kn_value_free(kn_play(env, str, length));
 	kn_env_destroy(env);
 	kn_shutdown();
 
+#ifdef MAP_SCRIPTS
+	if (mapped)
+		munmap(str, length);
+	else
+#endif /* MAP_SCRIPTS */
 	if (argv[1][1] == 'f')
 		kn_heap_free(str);
 #endif /* KN_RECKLESS */
@@ -0,0 +1,272 @@
+#include "optimize.h" /* prototypes, kn_ast, kn_value */
+#include "function.h" /* kn_fn_* */
+#include "string.h"   /* kn_string_intern, kn_string_deref, kn_string_free */
+#include "shared.h"   /* KN_UNLIKELY, KN_HAS_BUILTIN */
+#include <stdbool.h>  /* bool, true, false */
+#include <stddef.h>   /* NULL */
+
+/**
+ * The longest string that's folded by repeating a literal string, so that a `* "ab" 1000000` which
+ * is never reached doesn't end up in memory.
+ **/
+#ifndef KN_OPTIMIZE_MAX_REPEAT_LENGTH
+# define KN_OPTIMIZE_MAX_REPEAT_LENGTH 4096
+#endif /* !KN_OPTIMIZE_MAX_REPEAT_LENGTH */
+
+// Literals are the only values whose evaluation does nothing but return themselves.
+static bool is_literal(kn_value value) {
+	return !kn_value_is_ast(value) && !kn_value_is_variable(value);
+}
+
+// Frees `ast` and every argument except for `keep`, which is returned.
+static kn_value replace_with_arg(struct kn_ast *ast, size_t keep) {
+	kn_value arg = ast->args[keep];
+
+	for (size_t i = 0; i < ast->argc; ++i)
+		if (i != keep)
+			kn_value_free(ast->args[i]);
+
+	kn_ast_dealloc_shallow(ast);
+	return arg;
+}
+
+static bool is_power_of_two(kn_value value) {
+	if (!kn_value_is_integer(value))
+		return false;
+
+	kn_integer integer = kn_value_as_integer(value);
+	return 1 < integer && (integer & (integer - 1)) == 0;
+}
+
+// Whether `value` is an operand that superinstructions read directly: a variable or an integer.
+static bool is_slot(kn_value value) {
+	return kn_value_is_variable(value) || kn_value_is_integer(value);
+}
+
+// Returns the superinstruction that `ast` can be fused into, or `NULL` if there's none.
+static const struct kn_function *fuse(const struct kn_ast *ast) {
+	const struct kn_function *function = ast->function;
+	const kn_value *args = ast->args;
+
+	if (function == &kn_fn_add && kn_value_is_variable(args[0]) && kn_value_is_integer(args[1]))
+		return &kn_fn_add_immediate;
+
+	if (
+		function == &kn_fn_assign && kn_value_is_variable(args[0]) && kn_value_is_ast(args[1])
+		&& kn_value_as_ast(args[1])->function == &kn_fn_add_immediate
+	) return &kn_fn_assign_add_immediate;
+
+	if ((function == &kn_fn_lth || function == &kn_fn_gth) && is_slot(args[0]) && is_slot(args[1]))
+		return function == &kn_fn_lth ? &kn_fn_lth_slots : &kn_fn_gth_slots;
+
+	if (function == &kn_fn_eql && kn_value_is_variable(args[0]) && is_literal(args[1]))
+		return &kn_fn_eql_immediate;
+
+	if (function == &kn_fn_while && kn_value_is_ast(args[0])) {
+		const struct kn_function *condition = kn_value_as_ast(args[0])->function;
+
+		if (condition == &kn_fn_lth_slots || condition == &kn_fn_gth_slots)
+			return &kn_fn_while_slots;
+	}
+
+	return NULL;
+}
+
+// Whether `integer` fits in a `kn_value` (see `kn_value_new_integer`).
+static bool is_representable(kn_integer integer) {
+	return integer == (((kn_integer) ((kn_value) integer << KN_SHIFT)) >> KN_SHIFT);
+}
+
+// Whether `+`, `-`, `*`, or `^` of the integers `lhs` and `rhs` is representable. Folding one that
+// isn't would overflow while parsing, even if it's never run.
+static bool is_integer_result_representable(
+	const struct kn_function *function,
+	kn_integer lhs,
+	kn_integer rhs
+) {
+	kn_integer result;
+
+	if (function == &kn_fn_pow) {
+		// Negative exponents truncate to zero, except for bases of `0` (which divide by zero).
+		if (rhs < 0)
+			return lhs != 0;
+
+		// Every other base overflows within a few dozen multiplications.
+		if (-1 <= lhs && lhs <= 1)
+			return true;
+
+		for (result = 1; rhs != 0; --rhs) {
+			if (!is_integer_result_representable(&kn_fn_mul, result, lhs))
+				return false;
+
+			result *= lhs;
+		}
+
+		return true;
+	}
+
+#if KN_HAS_BUILTIN(__builtin_add_overflow) && KN_HAS_BUILTIN(__builtin_sub_overflow) \
+	&& KN_HAS_BUILTIN(__builtin_mul_overflow)
+	bool overflowed;
+
+	if (function == &kn_fn_add)
+		overflowed = __builtin_add_overflow(lhs, rhs, &result);
+	else if (function == &kn_fn_sub)
+		overflowed = __builtin_sub_overflow(lhs, rhs, &result);
+	else
+		overflowed = __builtin_mul_overflow(lhs, rhs, &result);
+
+	return !overflowed && is_representable(result);
+#else
+	// Without the builtins, overflow can't be detected without UB, so these are never folded.
+	(void) function;
+	(void) lhs;
+	(void) rhs;
+	return false;
+#endif /* KN_HAS_BUILTIN(__builtin_*_overflow) */
+}
+
+// Whether `ast`, whose arguments are all literals, can be evaluated without side effects or errors.
+static bool can_fold(const struct kn_ast *ast) {
+	const struct kn_function *function = ast->function;
+	kn_value lhs = ast->args[0];
+
+	if (function == &kn_fn_not || function == &kn_fn_length || function == &kn_fn_eql)
+		return true;
+
+	if (function == &kn_fn_negate)
+		return is_integer_result_representable(&kn_fn_sub, 0, kn_value_to_integer(lhs));
+
+	if (function == &kn_fn_lth || function == &kn_fn_gth)
+		return kn_value_is_integer(lhs) || kn_value_is_string(lhs);
+
+	if (function == &kn_fn_add && kn_value_is_string(lhs))
+		return true;
+
+	if (function == &kn_fn_add || function == &kn_fn_sub || function == &kn_fn_pow)
+		return kn_value_is_integer(lhs) && is_integer_result_representable(
+			function, kn_value_as_integer(lhs), kn_value_to_integer(ast->args[1])
+		);
+
+	if (function == &kn_fn_div || function == &kn_fn_mod)
+		return kn_value_is_integer(lhs) && kn_value_to_integer(ast->args[1]) != 0;
+
+	if (function == &kn_fn_mul) {
+		if (kn_value_is_integer(lhs))
+			return is_integer_result_representable(
+				function, kn_value_as_integer(lhs), kn_value_to_integer(ast->args[1])
+			);
+
+		if (!kn_value_is_string(lhs))
+			return false;
+
+		kn_integer amount = kn_value_to_integer(ast->args[1]);
+
+		return 0 <= amount && amount <= KN_OPTIMIZE_MAX_REPEAT_LENGTH
+			&& (size_t) amount * kn_length(kn_value_as_string(lhs)) <= KN_OPTIMIZE_MAX_REPEAT_LENGTH;
+	}
+
+	return false;
+}
+
+// Evaluates `ast`, which `can_fold`, and frees it.
+static kn_value fold(struct kn_ast *ast) {
+	kn_value result = kn_ast_run(ast);
+
+	// Folded strings are interned just like literals, so they live as long as the program does.
+	if (kn_value_is_string(result)) {
+		struct kn_string *string = kn_value_as_string(result);
+
+		result = kn_value_new(kn_string_intern(kn_string_deref(string), kn_length(string)));
+		kn_string_free(string);
+	}
+
+	kn_value_free(kn_value_new(ast));
+#ifndef KN_USE_REFCOUNT
+	kn_ast_dealloc_shallow(ast); // without refcounting, `kn_value_free` doesn't free asts.
+#endif /* !KN_USE_REFCOUNT */
+	return result;
+}
+
+kn_value kn_optimize_ast(struct kn_ast *ast) {
+	const struct kn_function *function = ast->function;
+	kn_value *args = ast->args;
+	bool all_literals = true;
+
+	for (size_t i = 0; i < ast->argc; ++i)
+		all_literals = all_literals && is_literal(args[i]);
+
+	if (all_literals && ast->argc != 0 && can_fold(ast))
+		return fold(ast);
+
+	// Branches whose conditions are literals.
+	if (function == &kn_fn_if && is_literal(args[0]))
+		return replace_with_arg(ast, kn_value_to_boolean(args[0]) ? 1 : 2);
+
+	if (function == &kn_fn_and && is_literal(args[0]))
+		return replace_with_arg(ast, kn_value_to_boolean(args[0]) ? 1 : 0);
+
+	if (function == &kn_fn_or && is_literal(args[0]))
+		return replace_with_arg(ast, kn_value_to_boolean(args[0]) ? 0 : 1);
+
+	if (function == &kn_fn_while && is_literal(args[0]) && !kn_value_to_boolean(args[0])) {
+		kn_value_free(replace_with_arg(ast, 0));
+		return KN_NULL;
+	}
+
+	if (function == &kn_fn_then) {
+		// Since evaluating anything other than an ast is meaningless (evaluating
+		// undefined variables is UB so we choose to just ignore it), statements
+		// other than the last that aren't asts are removed from sequences.
+		size_t length = 0;
+
+		for (size_t i = 0; i + 1 < ast->argc; ++i) {
+			if (kn_value_is_ast(args[i]))
+				args[length++] = args[i];
+			else
+				kn_value_free(args[i]);
+		}
+
+		args[length++] = args[ast->argc - 1];
+		ast->argc = (unsigned int) length;
+
+		if (length == 1)
+			return replace_with_arg(ast, 0);
+	}
+
+	// Shifting and masking by literal powers of two.
+	if (ast->argc == 2 && is_power_of_two(args[1])) {
+		if (function == &kn_fn_mul)
+			ast->function = &kn_fn_mul_pow2;
+		else if (function == &kn_fn_div)
+			ast->function = &kn_fn_div_pow2;
+		else if (function == &kn_fn_mod)
+			ast->function = &kn_fn_mod_pow2;
+	}
+
+	// Common shapes of asts, which are fused into superinstructions.
+	const struct kn_function *fused = fuse(ast);
+
+	if (fused != NULL)
+		ast->function = fused;
+
+	if (KN_UNLIKELY(function == &kn_fn_block && !kn_value_is_ast(args[0]))) {
+		// `BLOCK` always returns an ast, so non-asts are wrapped in a no-op.
+		struct kn_ast *block_arg = kn_ast_alloc(1);
+		block_arg->function = &kn_fn_noop;
+		block_arg->args[0] = args[0];
+		args[0] = kn_value_new(block_arg);
+	}
+
+	if (KN_UNLIKELY(function == &kn_fn_output && kn_value_is_ast(args[0]))) {
+		// `OUTPUT ^ list sep` reuses the `^` ast, so the joined list is streamed to stdout.
+		struct kn_ast *arg = kn_value_as_ast(args[0]);
+
+		if (arg->function == &kn_fn_pow) {
+			arg->function = &kn_fn_output_join;
+			return replace_with_arg(ast, 0);
+		}
+	}
+
+	return kn_value_new(ast);
+}
@@ -0,0 +1,29 @@
+#ifndef KN_OPTIMIZE_H
+#define KN_OPTIMIZE_H
+
+#include "ast.h"   /* kn_ast */
+#include "value.h" /* kn_value */
+
+/**
+ * Simplifies a freshly parsed `ast`, returning the value that should be used in its place.
+ *
+ * This is called by the parser on every ast once its arguments have been parsed (and so already
+ * simplified), so the whole tree is optimized bottom-up as it's built. Ownership of `ast` is passed
+ * to this function, and if it isn't returned, it's freed.
+ *
+ * The simplifications are:
+ * - Constant folding: functions without side effects whose arguments are all literals (eg
+ *   `+ 1 2` or `* "ab" 3`) are evaluated once, with the usual `kn_fn_*` semantics. This is only
+ *   done when evaluating them can't fail, so errors are still only raised if they're reached.
+ * - Dead branches: `IF`, `&`, `|`, and `WHILE` with literal conditions are replaced with the
+ *   branch that'd be taken, and statements of sequences (besides the last) that aren't asts are
+ *   removed.
+ * - Strength reduction: `*`, `/`, and `%` by a literal power of two use `kn_fn_mul_pow2` and
+ *   friends, which shift and mask integers instead.
+ * - Superinstructions: common shapes such as `= i + i 1`, `< i n`, and `WHILE < i n ...` are fused
+ *   into functions that read their variables and literals directly (see `kn_fn_add_immediate`).
+ * - `OUTPUT ^ list sep` is fused into `kn_fn_output_join`.
+ **/
+kn_value kn_optimize_ast(struct kn_ast *ast);
+
+#endif /* !KN_OPTIMIZE_H */
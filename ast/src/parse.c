@@ -1,57 +1,55 @@
 #include <assert.h> /* assert */
 #include <stddef.h> /* size_t */
-#include <ctype.h>  /* isspace, isdigit, islower, isupper */
-#include <string.h> /* strndup, memcpy */
+#include <ctype.h>  /* isdigit, islower */
+#include <string.h> /* strndup, memcpy, memchr */
 
 #include "parse.h"    /* prototypes, kn_value, kn_integer, kn_value_new_integer,
                          kn_value_new_variable, kn_value_new_string,
                          kn_value_new_ast, KN_UNDEFINED, KN_TRUE, KN_FALSE,
                          KN_NULL, kn_function, <all the function definitions> */
-#include "string.h"   /* kn_string_new_borrowed */
+#include "string.h"   /* kn_string_intern */
 #include "ast.h"      /* kn_ast, kn_ast_alloc */
+#include "optimize.h" /* kn_optimize_ast */
 #include "shared.h"   /* KN_UNREACHABLE */
 #include "env.h"      /* kn_variable, kn_env_fetch */
 #include "list.h"
+#include "scan.h"     /* kn_scan_whitespace, kn_scan_identifier, kn_scan_keyword,
+                         kn_scan_digits, kn_scan_string */
 
-// Check to see if the character is considered whitespace to Knight.
-static int iswhitespace(char c) {
-	return isspace(c) || c == ':' || c == '(' || c == ')';
-}
+void kn_parse_strip(struct kn_stream *stream) {
+	const char *source = stream->source;
+	size_t position = stream->position;
 
-// Checks to see if the character is part of a word function body.
-static int iswordfunc(char c) {
-	return isupper(c) || c == '_';
-}
+	assert(kn_scan_whitespace(source, position, stream->length) != position || source[position] == '#');
 
-void kn_parse_strip(struct kn_stream *stream) {
-	assert(iswhitespace(kn_stream_peek(stream)) || kn_stream_peek(stream) == '#');
+	while (true) {
+		position = kn_scan_whitespace(source, position, stream->length);
 
-	while (!kn_stream_is_eof(stream)) {
-		char c = kn_stream_peek(stream);
+		if (position == stream->length || source[position] != '#')
+			break;
 
-		if (KN_UNLIKELY(c == '#')) {
-			while (!kn_stream_is_eof(stream) && (c = kn_stream_peek(stream)) != '\n')
-				kn_stream_advance(stream);
-		}
+		// `memchr` is already vectorized, so comments don't need a scanner of their own.
+		const char *newline = memchr(source + position, '\n', stream->length - position);
 
-		if (!iswhitespace(c))
+		if (newline == NULL) {
+			position = stream->length;
 			break;
+		}
 
-		while (!kn_stream_is_eof(stream) && iswhitespace(kn_stream_peek(stream)))
-			kn_stream_advance(stream);
+		position = (size_t) (newline - source);
 	}
+
+	stream->position = position;
 }
 
 kn_integer kn_parse_integer(struct kn_stream *stream) {
 	assert(isdigit(kn_stream_peek(stream)));
 
+	size_t end = kn_scan_digits(stream->source, stream->position, stream->length);
 	kn_integer integer = 0;
 
-	char c;
-	while (!kn_stream_is_eof(stream) && isdigit(c = kn_stream_peek(stream))) {
-		integer = integer*10 + (kn_integer) (c - '0');
-		kn_stream_advance(stream);
-	}
+	for (; stream->position < end; ++stream->position)
+		integer = integer*10 + (kn_integer) (stream->source[stream->position] - '0');
 
 	return integer;
 }
@@ -64,21 +62,23 @@ struct kn_string *kn_parse_string(struct kn_stream *stream) {
 	assert(quote == '\'' || quote == '\"');
 
 	size_t start = stream->position;
-	char c;
 
-	while (!kn_stream_is_eof(stream) && quote != (c = kn_stream_peek(stream))) {
-		if (c == '\0')
-			kn_error("nul is not allowed in knight strings");
-		kn_stream_advance(stream);
-	}
+	stream->position = kn_scan_string(stream->source, start, stream->length, quote);
+
+	if (!kn_stream_is_eof(stream) && kn_stream_peek(stream) == '\0')
+		kn_error("nul is not allowed in knight strings");
 
 	if (kn_stream_is_eof(stream))
-		kn_error("unterminated quote encountered: '%s'", stream->source + start);
+		kn_error(
+			"unterminated quote encountered: '%.*s'",
+			(int) (stream->length - start),
+			stream->source + start
+		);
 
 	assert(kn_stream_peek(stream) == quote);
 	kn_stream_advance(stream);
 
-	return kn_string_new_borrowed(stream->source + start, stream->position - start - 1);
+	return kn_string_intern(stream->source + start, stream->position - start - 1);
 }
 
 struct kn_variable *kn_parse_variable(struct kn_stream *stream) {
@@ -86,19 +86,137 @@ struct kn_variable *kn_parse_variable(struct kn_stream *stream) {
 	assert(islower(kn_stream_peek(stream)) || kn_stream_peek(stream) == '_');
 
 	size_t start = stream->position;
-	char c;
+	stream->position = kn_scan_identifier(stream->source, start, stream->length);
+
+	return kn_env_fetch(stream->env, stream->source + start, stream->position - start);
+}
 
-	while (
-		!kn_stream_is_eof(stream)
-		&& (islower(c = kn_stream_peek(stream)) || isdigit(c) || c == '_')
-	) {
-		kn_stream_advance(stream);
+// Strips whitespace, and then consumes the next token if it's a `;`, returning whether it was.
+static bool parse_then(struct kn_stream *stream) {
+	size_t position = stream->position;
+
+	if (position != stream->length) {
+		char c = stream->source[position];
+
+		if (kn_scan_whitespace(stream->source, position, stream->length) != position || c == '#')
+			kn_parse_strip(stream);
 	}
 
-	return kn_env_fetch(stream->env, stream->source + start, stream->position - start);
+	if (kn_stream_is_eof(stream) || kn_stream_peek(stream) != ';')
+		return false;
+
+	kn_stream_advance(stream);
+	return true;
+}
+
+#ifdef KN_USE_GC
+// Allocates a sequence with room for `KN_MAX_ARGC` statements, for `parse_sequence`.
+static struct kn_ast *alloc_sequence(void) {
+	struct kn_ast *ast = kn_ast_alloc(KN_MAX_ARGC);
+
+	// Statements that haven't been parsed yet are marked as `NULL`.
+	for (size_t i = 0; i < KN_MAX_ARGC; ++i)
+		ast->args[i] = KN_NULL;
+
+	ast->function = &kn_fn_then;
+	return ast;
+}
+#endif /* KN_USE_GC */
+
+// Parses the arguments of a `;` (which has already been consumed), as well as every `;` that
+// directly follows it as its second argument, into a single sequence. This way, long programs
+// aren't parsed (or run, or freed) with one level of recursion per statement.
+//
+// With `KN_USE_GC`, every ast has to fit in a cell, so chains are instead split into sequences of
+// at most `KN_MAX_ARGC` statements, each of which ends with the next one. They're linked together
+// as they're parsed so that the collector can reach them, and are optimized from the back.
+static kn_value parse_sequence(struct kn_stream *stream) {
+#ifdef KN_USE_GC
+	// `first` keeps the whole chain reachable, as `sequences` isn't scanned by the collector.
+	struct kn_ast *first = alloc_sequence(), *ast = first;
+	struct kn_ast **sequences = kn_heap_malloc(sizeof(struct kn_ast *) * 8);
+	size_t length = 0, amount = 1, capacity = 8;
+
+	sequences[0] = first;
+
+	while (true) {
+		// If there's only room for one more statement, the rest of the chain continues in a new one.
+		if (length + 1 == KN_MAX_ARGC) {
+			if (amount == capacity) {
+				capacity *= 2;
+				sequences = kn_heap_realloc(sequences, sizeof(struct kn_ast *) * capacity);
+			}
+
+			struct kn_ast *next = alloc_sequence();
+			ast->args[length] = kn_value_new(next);
+			sequences[amount++] = ast = next;
+			length = 0;
+		}
+
+		if ((ast->args[length++] = kn_parse_value(stream)) == KN_UNDEFINED)
+			kn_error("unable to parse arg 0 for function ';'");
+
+		if (parse_then(stream))
+			continue;
+
+		// This was the last `;` of the chain, so its second argument is the last statement.
+		if ((ast->args[length++] = kn_parse_value(stream)) == KN_UNDEFINED)
+			kn_error("unable to parse arg 1 for function ';'");
+
+		break;
+	}
+
+	ast->argc = (unsigned int) length;
+
+	// Optimizing a sequence can replace it, so the one before it is updated before it's optimized.
+	for (size_t i = amount - 1; i != 0; --i)
+		sequences[i - 1]->args[KN_MAX_ARGC - 1] = kn_optimize_ast(sequences[i]);
+
+	kn_heap_free(sequences);
+	return kn_optimize_ast(first);
+#else
+	kn_value initial[KN_MAX_ARGC], *statements = initial;
+	size_t length = 0, capacity = KN_MAX_ARGC;
+
+	while (true) {
+		// Make sure there's room for both of this `;`'s arguments.
+		if (capacity - length < 2) {
+			capacity *= 2;
+
+			if (statements == initial)
+				statements = memcpy(kn_heap_malloc(sizeof(kn_value) * capacity), initial, sizeof(initial));
+			else
+				statements = kn_heap_realloc(statements, sizeof(kn_value) * capacity);
+		}
+
+		if ((statements[length++] = kn_parse_value(stream)) == KN_UNDEFINED)
+			kn_error("unable to parse arg 0 for function ';'");
+
+		if (parse_then(stream))
+			continue;
+
+		// This was the last `;` of the chain, so its second argument is the last statement.
+		if ((statements[length++] = kn_parse_value(stream)) == KN_UNDEFINED)
+			kn_error("unable to parse arg 1 for function ';'");
+
+		break;
+	}
+
+	struct kn_ast *ast = kn_ast_alloc(length);
+	ast->function = &kn_fn_then;
+	memcpy(ast->args, statements, sizeof(kn_value) * length);
+
+	if (statements != initial)
+		kn_heap_free(statements);
+
+	return kn_optimize_ast(ast);
+#endif /* KN_USE_GC */
 }
 
 kn_value kn_parse_ast(struct kn_stream *stream, const struct kn_function *fn) {
+	if (fn == &kn_fn_then)
+		return parse_sequence(stream);
+
 	struct kn_ast *ast = kn_ast_alloc(fn->arity);
 	ast->function = fn;
 
@@ -109,29 +227,11 @@ kn_value kn_parse_ast(struct kn_stream *stream, const struct kn_function *fn) {
 			kn_error("unable to parse arg %zu for function '%s'", i, fn->name);
 	}
 
-	// Efficiency improvements.
-	if (KN_UNLIKELY(fn == &kn_fn_block && !kn_value_is_ast(ast->args[0]))) {
-		struct kn_ast *block_arg = kn_ast_alloc(1);
-		block_arg->function = &kn_fn_noop;
-		block_arg->args[0] = ast->args[0];
-		ast->args[0] = kn_value_new(block_arg);
-	}
-
-	if (KN_UNLIKELY(fn == &kn_fn_then && !kn_value_is_ast(ast->args[0]))) {
-		// Since evaluating anything other than an ast is meaningless (evaluating
-		// undefined variables is UB so we choose to just ignore it), if the first
-		// value is not an ast, we just return the second function's value.
-		kn_value rhs = ast->args[1];
-		kn_heap_free(ast);
-		return rhs;
-	}
-
-	return kn_value_new(ast);
+	return kn_optimize_ast(ast);
 }
 
 static void strip_keyword(struct kn_stream *stream) {
-	while (!kn_stream_is_eof(stream) && iswordfunc(kn_stream_peek(stream)))
-		kn_stream_advance(stream);
+	stream->position = kn_scan_keyword(stream->source, stream->position, stream->length);
 }
 
 // Macros used either for computed gotos or switch statements (the switch
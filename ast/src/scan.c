@@ -0,0 +1,145 @@
+#include "scan.h"
+#include "shared.h" /* KN_HAS_BUILTIN */
+#include <stdbool.h> /* bool */
+
+#if !defined(KN_NO_SIMD) && KN_HAS_BUILTIN(__builtin_ctz)
+# if defined(__AVX2__)
+#  include <immintrin.h>
+#  define VECTOR_LENGTH 32
+#  define VECTOR_MASK 0xffffffffu
+typedef __m256i vector;
+#  define vector_load(ptr) _mm256_loadu_si256((const __m256i *) (const void *) (ptr))
+#  define vector_splat(byte) _mm256_set1_epi8((char) (byte))
+#  define vector_eq(lhs, rhs) _mm256_cmpeq_epi8(lhs, rhs)
+#  define vector_or(lhs, rhs) _mm256_or_si256(lhs, rhs)
+#  define vector_sub(lhs, rhs) _mm256_sub_epi8(lhs, rhs)
+#  define vector_min(lhs, rhs) _mm256_min_epu8(lhs, rhs)
+#  define vector_mask(bytes) ((unsigned) _mm256_movemask_epi8(bytes))
+# elif defined(__SSE2__)
+#  include <emmintrin.h>
+#  define VECTOR_LENGTH 16
+#  define VECTOR_MASK 0xffffu
+typedef __m128i vector;
+#  define vector_load(ptr) _mm_loadu_si128((const __m128i *) (const void *) (ptr))
+#  define vector_splat(byte) _mm_set1_epi8((char) (byte))
+#  define vector_eq(lhs, rhs) _mm_cmpeq_epi8(lhs, rhs)
+#  define vector_or(lhs, rhs) _mm_or_si128(lhs, rhs)
+#  define vector_sub(lhs, rhs) _mm_sub_epi8(lhs, rhs)
+#  define vector_min(lhs, rhs) _mm_min_epu8(lhs, rhs)
+#  define vector_mask(bytes) ((unsigned) _mm_movemask_epi8(bytes))
+# endif
+#endif /* !KN_NO_SIMD && KN_HAS_BUILTIN(__builtin_ctz) */
+
+static inline bool in_range(char byte, char low, char high) {
+	return (unsigned char) (byte - low) <= (unsigned char) (high - low);
+}
+
+static inline bool is_whitespace(char byte) {
+	return byte == ' ' || in_range(byte, '\t', '\r') || byte == ':' || byte == '(' || byte == ')';
+}
+
+static inline bool is_identifier(char byte) {
+	return in_range(byte, 'a', 'z') || in_range(byte, '0', '9') || byte == '_';
+}
+
+static inline bool is_keyword(char byte) {
+	return in_range(byte, 'A', 'Z') || byte == '_';
+}
+
+#ifdef VECTOR_LENGTH
+// The vector versions of the functions above, which set every byte in the class to `0xff`.
+static inline vector vector_in_range(vector bytes, char low, char high) {
+	vector offset = vector_sub(bytes, vector_splat(low));
+	return vector_eq(vector_min(offset, vector_splat(high - low)), offset);
+}
+
+static inline vector vector_is_whitespace(vector bytes) {
+	return vector_or(
+		vector_or(vector_eq(bytes, vector_splat(' ')), vector_in_range(bytes, '\t', '\r')),
+		vector_or(vector_eq(bytes, vector_splat(':')), vector_in_range(bytes, '(', ')'))
+	);
+}
+
+static inline vector vector_is_identifier(vector bytes) {
+	return vector_or(
+		vector_or(vector_in_range(bytes, 'a', 'z'), vector_in_range(bytes, '0', '9')),
+		vector_eq(bytes, vector_splat('_'))
+	);
+}
+
+static inline vector vector_is_keyword(vector bytes) {
+	return vector_or(vector_in_range(bytes, 'A', 'Z'), vector_eq(bytes, vector_splat('_')));
+}
+
+static inline vector vector_is_digit(vector bytes) {
+	return vector_in_range(bytes, '0', '9');
+}
+
+// Skips `position` ahead a vector at a time while every byte matches `vector_is_class`, returning
+// from the enclosing function at the first byte that doesn't. Fewer than `VECTOR_LENGTH` bytes are
+// left afterwards, which are scanned normally.
+# define SCAN_VECTORS(vector_is_class)                                              \
+	for (; position + VECTOR_LENGTH <= length; position += VECTOR_LENGTH) {        \
+		unsigned outside = ~vector_mask(vector_is_class(vector_load(source + position))) \
+			& VECTOR_MASK;                                                         \
+		if (outside != 0)                                                          \
+			return position + (size_t) __builtin_ctz(outside);                     \
+	}
+#else
+# define SCAN_VECTORS(vector_is_class)
+#endif /* VECTOR_LENGTH */
+
+size_t kn_scan_whitespace(const char *source, size_t position, size_t length) {
+	SCAN_VECTORS(vector_is_whitespace)
+
+	while (position < length && is_whitespace(source[position]))
+		++position;
+
+	return position;
+}
+
+size_t kn_scan_identifier(const char *source, size_t position, size_t length) {
+	SCAN_VECTORS(vector_is_identifier)
+
+	while (position < length && is_identifier(source[position]))
+		++position;
+
+	return position;
+}
+
+size_t kn_scan_keyword(const char *source, size_t position, size_t length) {
+	SCAN_VECTORS(vector_is_keyword)
+
+	while (position < length && is_keyword(source[position]))
+		++position;
+
+	return position;
+}
+
+size_t kn_scan_digits(const char *source, size_t position, size_t length) {
+	SCAN_VECTORS(vector_is_digit)
+
+	while (position < length && in_range(source[position], '0', '9'))
+		++position;
+
+	return position;
+}
+
+size_t kn_scan_string(const char *source, size_t position, size_t length, char quote) {
+#ifdef VECTOR_LENGTH
+	vector quotes = vector_splat(quote), nuls = vector_splat('\0');
+
+	for (; position + VECTOR_LENGTH <= length; position += VECTOR_LENGTH) {
+		vector bytes = vector_load(source + position);
+		unsigned ends = vector_mask(vector_or(vector_eq(bytes, quotes), vector_eq(bytes, nuls)));
+
+		if (ends != 0)
+			return position + (size_t) __builtin_ctz(ends);
+	}
+#endif /* VECTOR_LENGTH */
+
+	while (position < length && source[position] != quote && source[position] != '\0')
+		++position;
+
+	return position;
+}
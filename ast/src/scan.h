@@ -0,0 +1,41 @@
+#ifndef KN_SCAN_H
+#define KN_SCAN_H
+
+#include <stddef.h> /* size_t */
+
+/**
+ * Functions that find where runs of a class of characters end, which the parser uses to skip over
+ * whitespace and tokens.
+ *
+ * When the compiler targets SSE2 or AVX2 (eg with `-mavx2`), these check 16 or 32 bytes at a time;
+ * otherwise (or if `KN_NO_SIMD` is defined), they check a byte at a time. Each one returns the
+ * position of the first byte at or after `position` that isn't part of the run, or `length` if
+ * every byte until then is.
+ **/
+
+/**
+ * Scans over whitespace, which includes `:`, `(`, and `)` as well as the usual characters.
+ **/
+size_t kn_scan_whitespace(const char *source, size_t position, size_t length);
+
+/**
+ * Scans over the rest of an identifier: lower case letters, digits, and `_`.
+ **/
+size_t kn_scan_identifier(const char *source, size_t position, size_t length);
+
+/**
+ * Scans over the rest of a word function: upper case letters and `_`.
+ **/
+size_t kn_scan_keyword(const char *source, size_t position, size_t length);
+
+/**
+ * Scans over digits.
+ **/
+size_t kn_scan_digits(const char *source, size_t position, size_t length);
+
+/**
+ * Scans over the contents of a string literal, stopping at either `quote` or a nul byte.
+ **/
+size_t kn_scan_string(const char *source, size_t position, size_t length, char quote);
+
+#endif /* !KN_SCAN_H */
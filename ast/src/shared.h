@@ -137,20 +137,43 @@ extern jmp_buf kn_play_start;
 
 typedef unsigned long long kn_hash_t;
 
+/**
+ * The state of a hash that's being computed a piece at a time.
+ *
+ * Strings are hashed eight bytes at a time, so the bytes of an incomplete word
+ * are kept in `tail` until the next piece completes it. That way, hashing a
+ * string in pieces gives the same result as hashing it all at once.
+ **/
+struct kn_hash_state {
+	kn_hash_t hash;
+	unsigned long long tail;
+	size_t length;
+};
+
 /**
  * Returns a hash for the first `length` characters of `str`.
  *
- * `str` must be at least `length` characters long, excluding any trailing `\0`
+ * `str` must be at least `length` characters long.
  **/
 kn_hash_t kn_hash(const char *str, size_t length);
 
 /**
- * Computes the hash of the first `length` characters of `str`, with the given
- * starting `hash`.
+ * Starts computing a hash a piece at a time.
+ **/
+void kn_hash_start(struct kn_hash_state *state);
+
+/**
+ * Adds the first `length` characters of `str` to the hash.
  *
- * This is useful to compute  hashes of non-sequential strings.
+ * This is useful to compute hashes of non-sequential strings.
+ **/
+void kn_hash_acc(struct kn_hash_state *state, const char *str, size_t length);
+
+/**
+ * Returns the hash of everything given to `kn_hash_acc`, which is the same as
+ * `kn_hash` of all of it at once.
  **/
-kn_hash_t kn_hash_acc(const char *str, size_t length, kn_hash_t hash);
+kn_hash_t kn_hash_finish(const struct kn_hash_state *state);
 
 void *kn_memdup(const void *mem, size_t length);
 
@@ -2,41 +2,125 @@
                        KN_STRING_NEW_EMBED */
 #include "shared.h" /* kn_heap_malloc, kn_hash, KN_LIKELY, KN_UNLIKELY */
 #include <stdlib.h> /* free, NULL */
-#include <string.h> /* strlen, strcmp, memcpy, strndup, strncmp, memcmp */
+#include <string.h> /* memcpy, memcmp */
+#include <stdint.h> /* uintptr_t, SIZE_MAX */
 #include <assert.h> /* assert */
-#include <ctype.h>
 #include "list.h"
 
 // The empty string.
 // we need the alignment for embedding.
 struct kn_string kn_string_empty = KN_STRING_NEW_EMBED("");
 
+#define BYTE_STRING(byte) { \
+		.flags = KN_STRING_FL_EMBED | KN_STRING_FL_INTERNED, \
+		.length = 1, \
+		.embed = { (char) (byte) } \
+	}
+#define BYTE_STRINGS_4(byte) \
+	BYTE_STRING(byte), BYTE_STRING(byte + 1), BYTE_STRING(byte + 2), BYTE_STRING(byte + 3)
+#define BYTE_STRINGS_16(byte) \
+	BYTE_STRINGS_4(byte), BYTE_STRINGS_4(byte + 4), BYTE_STRINGS_4(byte + 8), BYTE_STRINGS_4(byte + 12)
+#define BYTE_STRINGS_64(byte) \
+	BYTE_STRINGS_16(byte), BYTE_STRINGS_16(byte + 16), BYTE_STRINGS_16(byte + 32), BYTE_STRINGS_16(byte + 48)
+
+struct kn_string kn_string_bytes[256] = {
+	BYTE_STRINGS_64(0), BYTE_STRINGS_64(64), BYTE_STRINGS_64(128), BYTE_STRINGS_64(192)
+};
+
+// Remembers that the contents of `string` hash to `hash`.
+static void remember_hash(struct kn_string *string, kn_hash_t hash) {
+#ifdef KN_CONTAINER_CACHE
+	string->cached.hash = hash;
+	kn_flags(string) |= KN_STRING_FL_HASHED;
+#else
+	(void) string;
+	(void) hash;
+#endif /* KN_CONTAINER_CACHE */
+}
+
 #ifdef KN_STRING_CACHE
 # ifndef KN_STRING_CACHE_MAXLEN
 #  define KN_STRING_CACHE_MAXLEN 32
 # endif /* !KN_STRING_CACHE_MAXLEN */
-# ifndef KN_STRING_CACHE_LINELEN
-#  define KN_STRING_CACHE_LINELEN (1 << 14)
-# endif /* !KN_STRING_CACHE_LINELEN */
-
-static struct kn_string *cache[KN_STRING_CACHE_MAXLEN][KN_STRING_CACHE_LINELEN];
+# ifndef KN_STRING_CACHE_WAYS
+#  define KN_STRING_CACHE_WAYS 4
+# endif /* !KN_STRING_CACHE_WAYS */
+
+/*
+ * A set of strings whose hashes map to the same index, ordered from most to least recently used.
+ * The hashes are kept alongside the strings so that looking a string up doesn't touch any of the
+ * strings that it's not.
+ */
+struct cache_set {
+	kn_hash_t hashes[KN_STRING_CACHE_WAYS];
+	struct kn_string *strings[KN_STRING_CACHE_WAYS];
+};
+
+// Used until `kn_string_cache_resize` is first called, so the cache never has to be checked for.
+static struct cache_set initial_set;
+static struct cache_set *cache = &initial_set;
+static size_t cache_mask;
+static struct kn_string_cache_stats stats;
+
+static struct cache_set *get_cache_set(kn_hash_t hash) {
+	return &cache[hash & cache_mask];
+}
 
-static struct kn_string **cache_lookup(kn_hash_t hash, size_t length) {
+// Returns the way of `set` holding a string with the given `hash` and `length`, or
+// `KN_STRING_CACHE_WAYS` if there's none.
+static size_t find_way(const struct cache_set *set, kn_hash_t hash, size_t length) {
 	assert(length != 0);
 	assert(length <= KN_STRING_CACHE_MAXLEN);
 
-	return &cache[length - 1][hash & (KN_STRING_CACHE_LINELEN - 1)];
+	for (size_t way = 0; way < KN_STRING_CACHE_WAYS; ++way)
+		if (set->hashes[way] == hash
+			&& set->strings[way] != NULL
+			&& kn_length(set->strings[way]) == length)
+			return way;
+
+	return KN_STRING_CACHE_WAYS;
+}
+
+// Moves the string at `way` one step towards the front of its set, and returns it.
+static struct kn_string *promote_way(struct cache_set *set, size_t way) {
+	struct kn_string *string = set->strings[way];
+
+	if (way != 0) {
+		kn_hash_t hash = set->hashes[way];
+
+		set->hashes[way] = set->hashes[way - 1];
+		set->strings[way] = set->strings[way - 1];
+		set->hashes[way - 1] = hash;
+		set->strings[way - 1] = string;
+	}
+
+	return string;
+}
+
+// Removes the string at `way` from `set`, shifting the less recently used ones forward.
+static void remove_way(struct cache_set *set, size_t way) {
+	for (; way + 1 < KN_STRING_CACHE_WAYS; ++way) {
+		set->hashes[way] = set->hashes[way + 1];
+		set->strings[way] = set->strings[way + 1];
+	}
+
+	set->strings[KN_STRING_CACHE_WAYS - 1] = NULL;
 }
 
 struct kn_string *kn_string_cache_lookup(kn_hash_t hash, size_t length) {
 	if (length == 0 || KN_STRING_CACHE_MAXLEN < length)
 		return NULL;
 
-	return *cache_lookup(hash, length);
-}
+	struct cache_set *set = get_cache_set(hash);
+	size_t way = find_way(set, hash, length);
 
-static struct kn_string **get_cache_slot(const char *str, size_t length) {
-	return cache_lookup(kn_hash(str, length), length);
+	if (way == KN_STRING_CACHE_WAYS) {
+		++stats.misses;
+		return NULL;
+	}
+
+	++stats.hits;
+	return promote_way(set, way);
 }
 
 static void evict_string_active(struct kn_string *string) {
@@ -51,8 +135,8 @@ static void evict_string_active(struct kn_string *string) {
 
 static void deallocate_string(struct kn_string *string);
 static void evict_string(struct kn_string *string) {
-	// we only cache allocated strings.
-	assert(kn_flags(string) & KN_STRING_FL_STRUCT_ALLOC);
+	// we only cache allocated and interned strings.
+	assert(kn_flags(string) & (KN_STRING_FL_STRUCT_ALLOC | KN_STRING_FL_INTERNED));
 
 # ifdef KN_USE_REFCOUNT
 	if (string->refcount == 0) {
@@ -66,38 +150,204 @@ static void evict_string(struct kn_string *string) {
 	evict_string_active(string);
 }
 
-// Cache a string. note that it could have previously been cached.
-void kn_string_cache(struct kn_string *string) {
-	// empty strings should never be cached.
+// Adds `string` to the front of `set`, evicting the least recently used string if it's full.
+static void insert_string(struct cache_set *set, kn_hash_t hash, struct kn_string *string) {
+	struct kn_string *victim = set->strings[KN_STRING_CACHE_WAYS - 1];
+
+	if (victim != NULL) {
+		++stats.evictions;
+		evict_string(victim);
+	}
+
+	for (size_t way = KN_STRING_CACHE_WAYS - 1; way != 0; --way) {
+		set->hashes[way] = set->hashes[way - 1];
+		set->strings[way] = set->strings[way - 1];
+	}
+
+	kn_flags(string) |= KN_STRING_FL_CACHED;
+	set->hashes[0] = hash;
+	set->strings[0] = string;
+}
+
+static kn_hash_t hash_string(struct kn_string *string) {
+# ifdef KN_CONTAINER_CACHE
+	if (kn_flags(string) & KN_STRING_FL_HASHED)
+		return string->cached.hash;
+# endif /* KN_CONTAINER_CACHE */
+
+	kn_hash_t hash = kn_hash(kn_string_deref(string), kn_length(string));
+	remember_hash(string, hash);
+	return hash;
+}
+
+// Caches `string`, whose contents hash to `hash`. note that it could have previously been cached.
+static void cache_string(struct kn_string *string, kn_hash_t hash) {
+	// empty strings should never be cached, nor should ones too large for the cache.
 	assert(kn_length(string) != 0);
+	assert(kn_length(string) <= KN_STRING_CACHE_MAXLEN);
+
+	remember_hash(string, hash);
+	struct cache_set *set = get_cache_set(hash);
 
+	for (size_t way = 0; way < KN_STRING_CACHE_WAYS; ++way)
+		if (set->strings[way] == string)
+			return;
+
+	// A different string with the same hash is replaced, so lookups find the new one.
+	size_t way = find_way(set, hash, kn_length(string));
+	if (way != KN_STRING_CACHE_WAYS) {
+		evict_string(set->strings[way]);
+		remove_way(set, way);
+	}
+
+	insert_string(set, hash, string);
+}
+
+void kn_string_cache(struct kn_string *string) {
 	// If it's too large for the cache, then just ignore it.
 	if (KN_STRING_CACHE_MAXLEN < kn_length(string))
 		return;
 
-	struct kn_string **cacheline = get_cache_slot(
-		kn_string_deref(string),
-		kn_length(string)
-	);
+	cache_string(string, hash_string(string));
+}
+
+void kn_string_cache_resize(size_t sets) {
+	struct cache_set *old = cache;
+	size_t old_sets = cache_mask + 1;
+
+	if (sets == 0) {
+		kn_string_cleanup();
+
+		for (size_t i = 0; i < old_sets; ++i)
+			for (size_t way = 0; way < KN_STRING_CACHE_WAYS; ++way)
+				if (old[i].strings[way] != NULL)
+					evict_string_active(old[i].strings[way]);
+
+		memset(&initial_set, 0, sizeof(initial_set));
+		cache = &initial_set;
+		cache_mask = 0;
+	} else {
+		// Stop doubling before `power` would overflow; such a cache couldn't be allocated anyways.
+		size_t power = 1;
+		while (power < sets && power <= SIZE_MAX / 2)
+			power *= 2;
+
+		cache = kn_heap_alloc_array(struct cache_set, power);
+		memset(cache, 0, sizeof(struct cache_set) * power);
+		cache_mask = power - 1;
+
+		// Reinsert the least recently used strings first, so they're evicted first if need be.
+		for (size_t i = 0; i < old_sets; ++i)
+			for (size_t way = KN_STRING_CACHE_WAYS; way-- != 0;)
+				if (old[i].strings[way] != NULL)
+					insert_string(get_cache_set(old[i].hashes[way]), old[i].hashes[way], old[i].strings[way]);
+
+		if (old == &initial_set)
+			memset(&initial_set, 0, sizeof(initial_set));
+	}
 
-	// If there was something there and has no live references left, free it.
-	if (KN_LIKELY(*cacheline != NULL))
-		evict_string(*cacheline);
+	if (old != &initial_set)
+		kn_heap_free(old);
+}
 
-	// Indicate that the string is now cached, and replace the old cache line.
-	kn_flags(string) |= KN_STRING_FL_CACHED;
-	*cacheline = string;
+size_t kn_string_cache_max_sets(void) {
+	// Rounding up to a power of two at most doubles `sets`, so the cache's size still fits.
+	return SIZE_MAX / 2 / sizeof(struct cache_set);
+}
+
+struct kn_string_cache_stats kn_string_cache_stats(void) {
+	return stats;
+}
+
+void kn_string_cache_dump_stats(FILE *out) {
+	size_t lookups = stats.hits + stats.misses;
+
+	fprintf(out, "string cache: %zu of %zu lookups hit (%.1f%%), %zu evictions, %zu sets of %d\n",
+		stats.hits, lookups, lookups ? 100.0 * stats.hits / lookups : 0.0,
+		stats.evictions, cache_mask + 1, KN_STRING_CACHE_WAYS);
 }
 
 #endif /* KN_STRING_CACHE */
 
+/*
+ * The deepest a rope can be. Ropes are kept balanced, so this is far more than will ever be used.
+ */
+#define ROPE_MAX_DEPTH 96
+
+static bool is_rope(const struct kn_string *string) {
+	return kn_flags(string) & KN_STRING_FL_ROPE;
+}
+
+// Iterates over the contiguous pieces of a string, without flattening it if it's a rope.
+struct chunk_iter {
+	const struct kn_string *stack[ROPE_MAX_DEPTH + 1];
+	size_t length;
+};
+
+static const char *next_chunk(struct chunk_iter *iter, size_t *length) {
+	assert(iter->length != 0);
+	const struct kn_string *string = iter->stack[--iter->length];
+
+	while (is_rope(string)) {
+		iter->stack[iter->length++] = string->rope.right;
+		string = string->rope.left;
+	}
+
+	*length = kn_length(string);
+	return kn_string_deref(string);
+}
+
+// Like `memcmp`, but works with ropes.
+static int compare_chunks(const struct kn_string *lhs, const struct kn_string *rhs, size_t length) {
+	struct chunk_iter lhs_iter = { .stack = { lhs }, .length = 1 };
+	struct chunk_iter rhs_iter = { .stack = { rhs }, .length = 1 };
+	const char *lhs_chunk = NULL, *rhs_chunk = NULL;
+	size_t lhs_length = 0, rhs_length = 0;
+
+	for (size_t remaining = length; remaining != 0;) {
+		if (lhs_length == 0)
+			lhs_chunk = next_chunk(&lhs_iter, &lhs_length);
+
+		if (rhs_length == 0)
+			rhs_chunk = next_chunk(&rhs_iter, &rhs_length);
+
+		size_t amount = lhs_length < rhs_length ? lhs_length : rhs_length;
+		if (remaining < amount)
+			amount = remaining;
+
+		int cmp = memcmp(lhs_chunk, rhs_chunk, amount);
+		if (cmp)
+			return cmp;
+
+		lhs_chunk += amount;
+		rhs_chunk += amount;
+		lhs_length -= amount;
+		rhs_length -= amount;
+		remaining -= amount;
+	}
+
+	return 0;
+}
+
 bool kn_string_equal(const struct kn_string *lhs, const struct kn_string *rhs) {
 	if (lhs == rhs) // shortcut if they have the same pointer.
 		return true;
 
+	// No two interned strings have the same contents.
+	if (kn_flags(lhs) & kn_flags(rhs) & KN_STRING_FL_INTERNED)
+		return false;
+
+#ifdef KN_CONTAINER_CACHE
+	if ((kn_flags(lhs) & kn_flags(rhs) & KN_STRING_FL_HASHED) && lhs->cached.hash != rhs->cached.hash)
+		return false;
+#endif /* KN_CONTAINER_CACHE */
+
 	if (kn_length(lhs) != kn_length(rhs))
 		return false;
 
+	if (KN_UNLIKELY(is_rope(lhs) || is_rope(rhs)))
+		return !compare_chunks(lhs, rhs, kn_length(lhs));
+
 	return !memcmp(kn_string_deref(lhs), kn_string_deref(rhs), kn_length(lhs));
 }
 
@@ -108,8 +358,60 @@ kn_integer kn_string_compare(
 	if (lhs == rhs)
 		return 0;
 
-	// FIXME: don't use strcmp, use memcmp
-   return strcmp(kn_string_deref(lhs), kn_string_deref(rhs));
+	size_t lhslen = kn_length(lhs), rhslen = kn_length(rhs);
+	size_t minlen = lhslen < rhslen ? lhslen : rhslen;
+	int cmp;
+
+	if (KN_UNLIKELY(is_rope(lhs) || is_rope(rhs)))
+		cmp = compare_chunks(lhs, rhs, minlen);
+	else
+		cmp = memcmp(kn_string_deref(lhs), kn_string_deref(rhs), minlen);
+
+	// If one's a prefix of the other, the shorter one is smaller.
+	if (cmp == 0)
+		return (lhslen > rhslen) - (lhslen < rhslen);
+
+	return cmp;
+}
+
+// ASCII character classes, so that conversions don't depend on the locale (or on `char`'s sign).
+static inline bool in_range(char byte, char low, char high) {
+	return (unsigned char) (byte - low) <= (unsigned char) (high - low);
+}
+
+static inline bool is_space(char byte) {
+	return byte == ' ' || in_range(byte, '\t', '\r');
+}
+
+kn_integer kn_string_to_integer(const struct kn_string *string) {
+#ifdef KN_CONTAINER_CACHE
+	if (kn_flags(string) & KN_STRING_FL_INTEGER)
+		return string->cached.integer;
+#endif /* KN_CONTAINER_CACHE */
+
+	const char *ptr = kn_string_deref(string);
+	const char *end = ptr + kn_length(string);
+
+	while (ptr != end && is_space(*ptr))
+		++ptr;
+
+	bool is_neg = false;
+	if (ptr != end && (*ptr == '-' || *ptr == '+'))
+		is_neg = *ptr++ == '-';
+
+	// Accumulate as unsigned, so overflowing wraps around instead of being UB.
+	unsigned long long integer = 0;
+	while (ptr != end && in_range(*ptr, '0', '9'))
+		integer = integer * 10 + (unsigned long long) (*ptr++ - '0');
+
+	kn_integer result = (kn_integer) (is_neg ? -integer : integer);
+
+#ifdef KN_CONTAINER_CACHE
+	KN_CLANG_IGNORE("-Wcast-qual", ((struct kn_string *) string)->cached.integer = result;)
+	kn_flags(string) |= KN_STRING_FL_INTEGER;
+#endif /* KN_CONTAINER_CACHE */
+
+	return result;
 }
 
 // Allocate a `kn_string` and populate it with the given `str`.
@@ -117,9 +419,14 @@ static struct kn_string *allocate_heap_string(char *str, size_t length) {
 	assert(str != NULL);
 	assert(length != 0); // zero length strings are `empty`.
 
+#ifdef KN_USE_GC
+	struct kn_string *string = kn_gc_malloc(struct kn_string, KN_GC_KIND_STRING);
+#else
 	struct kn_string *string = kn_heap_alloc(struct kn_string);
+#endif /* KN_USE_GC */
 
 	string->ptr = str;
+	string->capacity = length;
 	kn_flags(string) = KN_STRING_FL_STRUCT_ALLOC;
 	string->length = length;
 
@@ -133,7 +440,11 @@ static struct kn_string *allocate_heap_string(char *str, size_t length) {
 static struct kn_string *allocate_embed_string(size_t length) {
 	assert(length != 0);
 
+#ifdef KN_USE_GC
+	struct kn_string *string = kn_gc_malloc(struct kn_string, KN_GC_KIND_STRING);
+#else
 	struct kn_string *string = kn_heap_alloc(struct kn_string);
+#endif /* KN_USE_GC */
 
 	kn_flags(string) = KN_STRING_FL_STRUCT_ALLOC | KN_STRING_FL_EMBED;
 	string->length = length;
@@ -145,6 +456,31 @@ static struct kn_string *allocate_embed_string(size_t length) {
 	return string;
 }
 
+// Creates a rope out of `left` and `right`, taking ownership of both.
+static struct kn_string *allocate_rope_string(struct kn_string *left, struct kn_string *right) {
+#ifdef KN_USE_GC
+	struct kn_string *string = kn_gc_malloc(struct kn_string, KN_GC_KIND_STRING);
+#else
+	struct kn_string *string = kn_heap_alloc(struct kn_string);
+#endif /* KN_USE_GC */
+
+	size_t left_depth = is_rope(left) ? left->rope.depth : 0;
+	size_t right_depth = is_rope(right) ? right->rope.depth : 0;
+
+	kn_flags(string) = KN_STRING_FL_STRUCT_ALLOC | KN_STRING_FL_ROPE;
+	string->length = kn_length(left) + kn_length(right);
+	string->rope.left = left;
+	string->rope.right = right;
+	string->rope.depth = 1 + (left_depth < right_depth ? right_depth : left_depth);
+	assert(string->rope.depth <= ROPE_MAX_DEPTH);
+
+#ifdef KN_USE_REFCOUNT
+	string->refcount = 1;
+#endif /* KN_USE_REFCOUNT */
+
+	return string;
+}
+
 // Actually deallocates the data associated with `string`.
 static void deallocate_string(struct kn_string *string) {
 	assert(string != NULL);
@@ -155,17 +491,27 @@ static void deallocate_string(struct kn_string *string) {
 
 	// If the struct isn't actually allocated, then return.
 	if (!(kn_flags(string) & KN_STRING_FL_STRUCT_ALLOC)) {
-		// Sanity check, as these are the only two non-struct-ptr flags.
-		assert(kn_flags(string) & (KN_STRING_FL_EMBED | KN_STRING_FL_STATIC));
+		// Sanity check, as these are the only non-struct-ptr flags.
+		assert(kn_flags(string) & (KN_STRING_FL_EMBED | KN_STRING_FL_INTERNED));
 		return;
 	}
 
-	// If we're not embedded, free the allocated string
-	if (KN_UNLIKELY(!(kn_flags(string) & KN_STRING_FL_EMBED)))
+	if (KN_UNLIKELY(is_rope(string))) {
+		// Ropes own a reference to each of their halves.
+		kn_string_free(string->rope.left);
+		kn_string_free(string->rope.right);
+	} else if (KN_UNLIKELY(kn_flags(string) & KN_STRING_FL_SLICE)) {
+		// Slices don't own their data, just a reference to the string that does.
+		kn_string_free(string->parent);
+	} else if (KN_UNLIKELY(!(kn_flags(string) & KN_STRING_FL_EMBED))) {
+		// If we're not embedded, free the allocated string
 		kn_heap_free(string->ptr);
+	}
 
+#ifndef KN_USE_GC
 	// Finally free the entire struct itself.
 	kn_heap_free(string);
+#endif /* !KN_USE_GC */
 }
 
 struct kn_string *kn_string_alloc(size_t length) {
@@ -178,13 +524,12 @@ struct kn_string *kn_string_alloc(size_t length) {
 		return allocate_embed_string(length);
 
 	// If it's too large to embed, heap allocate it with an uninit buffer.
-	return allocate_heap_string(kn_heap_malloc(length + 1), length);
+	return allocate_heap_string(kn_heap_malloc(length), length);
 }
 
 struct kn_string *kn_string_new_owned(char *str, size_t length) {
 	// sanity check for inputs.
 	assert(str != NULL);
-	assert(strlen(str) == length);
 
 	// If the input is empty, then just return an owned string.
 	if (KN_UNLIKELY(length == 0)) {
@@ -194,30 +539,43 @@ struct kn_string *kn_string_new_owned(char *str, size_t length) {
 
 	struct kn_string *string;
 
+	if (length == 1) {
+		string = kn_string_clone(&kn_string_bytes[(unsigned char) *str]);
+		kn_heap_free(str);
+		return string;
+	}
+
 #ifdef KN_STRING_CACHE
 	// if it's too big just dont cache it
 	if (KN_STRING_CACHE_MAXLEN < length)
 		return allocate_heap_string(str, length);
 
-	struct kn_string **cacheline = get_cache_slot(str, length);
-	string = *cacheline;
+	kn_hash_t hash = kn_hash(str, length);
+	struct cache_set *set = get_cache_set(hash);
+	size_t way = find_way(set, hash, length);
+
+	if (KN_LIKELY(way != KN_STRING_CACHE_WAYS)) {
+		string = set->strings[way];
 
-	if (KN_LIKELY(string != NULL)) {
 		// if it's the same as `str`, use the cached version.
-		if (KN_LIKELY(strcmp(kn_string_deref(string), str) == 0)) {
+		if (KN_LIKELY(memcmp(kn_string_deref(string), str, length) == 0)) {
+			++stats.hits;
 			kn_heap_free(str); // we don't need this string anymore, free it.
-			return kn_string_clone(string);
+			return kn_string_clone(promote_way(set, way));
 		}
 
 		evict_string(string);
+		remove_way(set, way);
 	}
+
+	++stats.misses;
 #endif /* KN_STRING_CACHE */
 
 	string = allocate_heap_string(str, length);
 
 #ifdef KN_STRING_CACHE
-	kn_flags(string) |= KN_STRING_FL_CACHED;
-	*cacheline = string;
+	remember_hash(string, hash);
+	insert_string(set, hash, string);
 #endif /* KN_STRING_CACHE */
 
 	return string;
@@ -227,47 +585,236 @@ struct kn_string *kn_string_new_borrowed(const char *str, size_t length) {
 	if (KN_UNLIKELY(length == 0))
 		return &kn_string_empty;
 
+	if (length == 1)
+		return kn_string_clone(&kn_string_bytes[(unsigned char) *str]);
+
 	struct kn_string *string;
 
 #ifdef KN_STRING_CACHE
 	if (KN_STRING_CACHE_MAXLEN < length)
 		return allocate_heap_string(kn_memdup(str, length), length);
 
-	struct kn_string **cached = get_cache_slot(str, length);
-	string = *cached;
+	kn_hash_t hash = kn_hash(str, length);
+	struct cache_set *set = get_cache_set(hash);
+	size_t way = find_way(set, hash, length);
+
+	if (KN_LIKELY(way != KN_STRING_CACHE_WAYS)) {
+		string = set->strings[way];
 
-	if (KN_LIKELY(string != NULL)) {
-		// cached strings must be allocated.
-		assert(kn_flags(string) & KN_STRING_FL_STRUCT_ALLOC);
-		assert(kn_length(string) == length);
+		// cached strings must be allocated or interned.
+		assert(kn_flags(string) & (KN_STRING_FL_STRUCT_ALLOC | KN_STRING_FL_INTERNED));
 
 		// if the string is the same, then that means we want the cached one.
-		if (KN_LIKELY(strncmp(kn_string_deref(string), str, length) == 0))
-			return kn_string_clone(string);
+		if (KN_LIKELY(memcmp(kn_string_deref(string), str, length) == 0)) {
+			++stats.hits;
+			return kn_string_clone(promote_way(set, way));
+		}
 
 		evict_string(string);
+		remove_way(set, way);
 	}
+
+	++stats.misses;
 #endif /* KN_STRING_CACHE */
 
 	// it may be embeddable, so don't just call `allocate_heap_string`.
 	string = kn_string_alloc(length);
 
 #ifdef KN_STRING_CACHE
-	kn_flags(string) |= KN_STRING_FL_CACHED;
-	*cached = string;
+	remember_hash(string, hash);
+	insert_string(set, hash, string);
 #endif /* KN_STRING_CACHE */
 
 	memcpy(kn_string_deref(string), str, length);
-	kn_string_deref(string)[length] = '\0';
 
 	return string;
 }
 
+/*
+ * Interned strings are allocated out of chunks of an arena, which are only freed by
+ * `kn_string_intern_teardown`. Strings too long to share a chunk get one to themselves.
+ */
+struct intern_chunk {
+	struct intern_chunk *next;
+	size_t used, capacity;
+	alignas(struct kn_string) char data[];
+};
+
+static struct intern_chunk *intern_chunks;
+
+// The interned strings, in an open-addressing hash table just like the environment's.
+static struct intern_slot {
+	kn_hash_t hash;
+	struct kn_string *string;
+} *intern_slots;
+
+static size_t interned_length, intern_capacity;
+
+// The source that `kn_string_intern_borrow` was given, which interned strings can point into.
+static const char *borrowed_source;
+static size_t borrowed_length;
+
+static void *intern_allocate(size_t size) {
+	size = (size + alignof(struct kn_string) - 1) & ~(alignof(struct kn_string) - 1);
+
+	if (intern_chunks == NULL || intern_chunks->capacity - intern_chunks->used < size) {
+		size_t capacity = size < KN_STRING_INTERN_ARENA_SIZE / 4 ? KN_STRING_INTERN_ARENA_SIZE : size;
+		struct intern_chunk *chunk = kn_heap_malloc(sizeof(struct intern_chunk) + capacity);
+
+		chunk->used = size;
+		chunk->capacity = capacity;
+
+		// Keep filling the current chunk if the new one is only for this string.
+		if (intern_chunks != NULL && capacity == size) {
+			chunk->next = intern_chunks->next;
+			intern_chunks->next = chunk;
+		} else {
+			chunk->next = intern_chunks;
+			intern_chunks = chunk;
+		}
+
+		return chunk->data;
+	}
+
+	void *ptr = intern_chunks->data + intern_chunks->used;
+	intern_chunks->used += size;
+	return ptr;
+}
+
+static void grow_intern_slots(void) {
+	size_t capacity = intern_capacity ? intern_capacity * 2 : 256;
+	struct intern_slot *slots = kn_heap_alloc_array(struct intern_slot, capacity);
+
+	for (size_t i = 0; i < capacity; ++i)
+		slots[i].string = NULL;
+
+	for (size_t i = 0; i < intern_capacity; ++i) {
+		if (intern_slots[i].string == NULL)
+			continue;
+
+		size_t index = intern_slots[i].hash & (capacity - 1);
+
+		while (slots[index].string != NULL)
+			index = (index + 1) & (capacity - 1);
+
+		slots[index] = intern_slots[i];
+	}
+
+	kn_heap_free(intern_slots);
+	intern_slots = slots;
+	intern_capacity = capacity;
+}
+
+struct kn_string *kn_string_intern(const char *str, size_t length) {
+	if (KN_UNLIKELY(length == 0))
+		return &kn_string_empty;
+
+	if (length == 1)
+		return kn_string_clone(&kn_string_bytes[(unsigned char) *str]);
+
+	// Keep at least a quarter of the slots empty, so that probes stay short.
+	if (KN_UNLIKELY(intern_capacity * 3 / 4 <= interned_length))
+		grow_intern_slots();
+
+	kn_hash_t hash = kn_hash(str, length);
+	size_t index = hash & (intern_capacity - 1);
+
+	for (; intern_slots[index].string != NULL; index = (index + 1) & (intern_capacity - 1)) {
+		struct kn_string *string = intern_slots[index].string;
+
+		if (
+			intern_slots[index].hash == hash
+			&& kn_length(string) == length
+			&& !memcmp(kn_string_deref(string), str, length)
+		) return kn_string_clone(string);
+	}
+
+	struct kn_string *string;
+	uintptr_t offset = (uintptr_t) str - (uintptr_t) borrowed_source;
+
+	if (length <= KN_STRING_EMBEDDED_LENGTH) {
+		string = intern_allocate(sizeof(struct kn_string));
+		kn_flags(string) = KN_STRING_FL_INTERNED | KN_STRING_FL_EMBED;
+		memcpy(string->embed, str, length);
+	} else if (offset <= borrowed_length && length <= borrowed_length - offset) {
+		// Interned strings are never modified, so they can share the source's memory.
+		string = intern_allocate(sizeof(struct kn_string));
+		kn_flags(string) = KN_STRING_FL_INTERNED;
+		string->ptr = (char *) str;
+		string->capacity = length;
+	} else {
+		string = intern_allocate(sizeof(struct kn_string) + length);
+		kn_flags(string) = KN_STRING_FL_INTERNED;
+		string->ptr = memcpy((char *) (string + 1), str, length);
+		string->capacity = length;
+	}
+
+	string->length = length;
+
+#ifdef KN_USE_REFCOUNT
+	// The table's reference keeps interned strings from ever being deallocated.
+	string->refcount = 1;
+#endif /* KN_USE_REFCOUNT */
+
+	remember_hash(string, hash);
+	intern_slots[index].hash = hash;
+	intern_slots[index].string = string;
+	++interned_length;
+
+#ifdef KN_STRING_CACHE
+	// Let strings with the same contents that are built at runtime find the interned one.
+	if (length <= KN_STRING_CACHE_MAXLEN)
+		cache_string(string, hash);
+#endif /* KN_STRING_CACHE */
+
+	return kn_string_clone(string);
+}
+
+void kn_string_intern_teardown(void) {
+	while (intern_chunks != NULL) {
+		struct intern_chunk *next = intern_chunks->next;
+		kn_heap_free(intern_chunks);
+		intern_chunks = next;
+	}
+
+	kn_heap_free(intern_slots);
+	intern_slots = NULL;
+	interned_length = intern_capacity = 0;
+
+	borrowed_source = NULL;
+	borrowed_length = 0;
+}
+
+void kn_string_intern_borrow(const char *source, size_t length) {
+	borrowed_source = source;
+	borrowed_length = length;
+}
+
 void kn_string_dealloc(struct kn_string *string) {
 #ifdef KN_USE_REFCOUNT
 	assert(string->refcount == 0);
 #endif /* KN_USE_REFCOUNT */
 
+#ifdef KN_USE_GC
+	// The collector only deallocates unreachable strings, so the cache can't keep this one.
+# ifdef KN_STRING_CACHE
+	if (kn_flags(string) & KN_STRING_FL_CACHED) {
+		struct cache_set *set = get_cache_set(hash_string(string));
+		size_t way = 0;
+
+		while (set->strings[way] != string) {
+			++way;
+			assert(way < KN_STRING_CACHE_WAYS);
+		}
+
+		remove_way(set, way);
+	}
+# endif /* KN_STRING_CACHE */
+
+	deallocate_string(string);
+	return;
+#endif /* KN_USE_GC */
+
 #ifdef KN_STRING_CACHE
 	// If we're not cached, deallocate the string.
 	if (!(kn_flags(string) & KN_STRING_FL_CACHED)) {
@@ -280,33 +827,24 @@ void kn_string_dealloc(struct kn_string *string) {
 #endif /* KN_STRING_CACHE */
 }
 
-struct kn_string *kn_string_clone_static(struct kn_string *string) {
-	if (!(kn_flags(string) & KN_STRING_FL_STATIC))
-		return string;
-
-	return kn_string_new_borrowed(kn_string_deref(string), kn_length(string));
-}
-
 void kn_string_cleanup(void) {
 #ifdef KN_STRING_CACHE
-	struct kn_string *string;
-
-	for (size_t i = 0; i < KN_STRING_CACHE_MAXLEN; ++i) {
-		for (size_t j = 0; j < KN_STRING_CACHE_LINELEN; ++j) {
-			string = cache[i][j];
+# ifdef KN_USE_REFCOUNT
+	for (size_t i = 0; i <= cache_mask; ++i) {
+		for (size_t way = KN_STRING_CACHE_WAYS; way-- != 0;) {
+			struct kn_string *string = cache[i].strings[way];
 
-			if (string != NULL) {
+			// If there are no more references to it, deallocate the string.
+			if (string != NULL && string->refcount == 0) {
 				// we only cache allocated strings.
 				assert(kn_flags(string) & KN_STRING_FL_STRUCT_ALLOC);
 
-# ifdef KN_USE_REFCOUNT
-				// If there are no more references to it, deallocate the string.
-				if (string->refcount == 0)
-					deallocate_string(string);
-# endif /* KN_USE_REFCOUNT */
+				remove_way(&cache[i], way);
+				deallocate_string(string);
 			}
 		}
 	}
+# endif /* KN_USE_REFCOUNT */
 #endif /* KN_STRING_CACHE */
 }
 
@@ -319,14 +857,253 @@ struct kn_list *kn_string_to_list(const struct kn_string *string) {
 	struct kn_list *chars = kn_list_alloc(length);
 	const char *ptr = kn_string_deref(string);
 
-	for (size_t i = 0; i < length; i++) {
-		char buf[2] = { ptr[i], 0 };
-		kn_list_set(chars, i, kn_value_new(kn_string_new_borrowed(buf, 1)));
-	}
+	for (size_t i = 0; i < length; i++)
+		kn_list_set(chars, i, kn_value_new(kn_string_clone(&kn_string_bytes[(unsigned char) ptr[i]])));
 
 	return chars;
 }
 
+#ifdef KN_USE_REFCOUNT
+// Appends `length` bytes of `str` to the end of `string`, which must be uniquely owned.
+static void append_in_place(struct kn_string *string, const char *str, size_t length) {
+	size_t oldlen = kn_length(string);
+	size_t newlen = oldlen + length;
+	char *ptr;
+
+#ifdef KN_CONTAINER_CACHE
+	// The string's contents are changing, so what was derived from them no longer holds.
+	kn_flags(string) &= ~(unsigned int) (KN_STRING_FL_HASHED | KN_STRING_FL_INTEGER);
+#endif /* KN_CONTAINER_CACHE */
+
+	if (kn_flags(string) & KN_STRING_FL_EMBED) {
+		if (newlen <= KN_STRING_EMBEDDED_LENGTH) {
+			ptr = string->embed;
+		} else {
+			// It no longer fits, so move it to the heap. (`ptr` overlaps `embed`, so copy first.)
+			size_t capacity = newlen * 2;
+			ptr = kn_heap_malloc(capacity);
+			memcpy(ptr, string->embed, oldlen);
+
+			kn_flags(string) &= ~KN_STRING_FL_EMBED;
+			string->ptr = ptr;
+			string->capacity = capacity;
+		}
+	} else if (string->capacity < newlen) {
+		// Grow geometrically, so repeated appends are amortized O(1).
+		string->capacity = newlen * 2;
+		string->ptr = ptr = kn_heap_realloc(string->ptr, string->capacity);
+	} else {
+		ptr = string->ptr;
+	}
+
+	memcpy(ptr + oldlen, str, length);
+	string->length = newlen;
+}
+#endif /* KN_USE_REFCOUNT */
+
+// Releases `rope`, returning owned references to its halves.
+static void split_rope(
+	struct kn_string *rope,
+	struct kn_string **left,
+	struct kn_string **right
+) {
+	assert(is_rope(rope));
+
+	*left = kn_string_clone(rope->rope.left);
+	*right = kn_string_clone(rope->rope.right);
+	kn_string_free(rope);
+}
+
+static size_t rope_depth(const struct kn_string *string) {
+	return is_rope(string) ? string->rope.depth : 0;
+}
+
+// `(a, (b, c))` -> `((a, b), c)`
+static struct kn_string *rotate_left(struct kn_string *rope) {
+	struct kn_string *a, *bc, *b, *c;
+
+	split_rope(rope, &a, &bc);
+	split_rope(bc, &b, &c);
+	return allocate_rope_string(allocate_rope_string(a, b), c);
+}
+
+// `((a, b), c)` -> `(a, (b, c))`
+static struct kn_string *rotate_right(struct kn_string *rope) {
+	struct kn_string *ab, *a, *b, *c;
+
+	split_rope(rope, &ab, &c);
+	split_rope(ab, &a, &b);
+	return allocate_rope_string(a, allocate_rope_string(b, c));
+}
+
+/*
+ * Joining two ropes is done the same way as joining two AVL trees: the shallower rope is attached
+ * to the deeper one at the level where their depths are within one of each other, and then the
+ * path back up is rebalanced. Rope nodes can be shared, so the nodes along that path are copied
+ * instead of being modified in place.
+ */
+static struct kn_string *join_ropes(struct kn_string *left, struct kn_string *right);
+
+// `left` is more than one level deeper than `right`.
+static struct kn_string *join_right(struct kn_string *left, struct kn_string *right) {
+	struct kn_string *a, *c, *joined;
+
+	split_rope(left, &a, &c);
+
+	if (rope_depth(c) <= rope_depth(right) + 1) {
+		joined = allocate_rope_string(c, right);
+
+		if (rope_depth(joined) <= rope_depth(a) + 1)
+			return allocate_rope_string(a, joined);
+
+		return rotate_left(allocate_rope_string(a, rotate_right(joined)));
+	}
+
+	joined = join_right(c, right);
+
+	if (rope_depth(joined) <= rope_depth(a) + 1)
+		return allocate_rope_string(a, joined);
+
+	return rotate_left(allocate_rope_string(a, joined));
+}
+
+// `right` is more than one level deeper than `left`.
+static struct kn_string *join_left(struct kn_string *left, struct kn_string *right) {
+	struct kn_string *c, *b, *joined;
+
+	split_rope(right, &c, &b);
+
+	if (rope_depth(c) <= rope_depth(left) + 1) {
+		joined = allocate_rope_string(left, c);
+
+		if (rope_depth(joined) <= rope_depth(b) + 1)
+			return allocate_rope_string(joined, b);
+
+		return rotate_right(allocate_rope_string(rotate_left(joined), b));
+	}
+
+	joined = join_left(left, c);
+
+	if (rope_depth(joined) <= rope_depth(b) + 1)
+		return allocate_rope_string(joined, b);
+
+	return rotate_right(allocate_rope_string(joined, b));
+}
+
+static struct kn_string *join_ropes(struct kn_string *left, struct kn_string *right) {
+	size_t left_depth = rope_depth(left), right_depth = rope_depth(right);
+
+	if (right_depth + 1 < left_depth)
+		return join_right(left, right);
+
+	if (left_depth + 1 < right_depth)
+		return join_left(left, right);
+
+	return allocate_rope_string(left, right);
+}
+
+static struct kn_string *concat_rope(struct kn_string *lhs, struct kn_string *rhs) {
+	struct kn_string *left, *right;
+
+	// Merge short strings into the neighbouring piece when it's also short, so that ropes built a
+	// little bit at a time don't end up with a node per piece.
+	if (
+		is_rope(lhs)
+		&& !is_rope(rhs)
+		&& !is_rope(lhs->rope.right)
+		&& kn_length(lhs->rope.right) + kn_length(rhs) < KN_STRING_ROPE_MIN_LENGTH
+	) {
+		split_rope(lhs, &left, &right);
+		return join_ropes(left, kn_string_concat(right, rhs));
+	}
+
+	if (
+		is_rope(rhs)
+		&& !is_rope(lhs)
+		&& !is_rope(rhs->rope.left)
+		&& kn_length(lhs) + kn_length(rhs->rope.left) < KN_STRING_ROPE_MIN_LENGTH
+	) {
+		split_rope(rhs, &left, &right);
+		return join_ropes(kn_string_concat(lhs, left), right);
+	}
+
+	return join_ropes(lhs, rhs);
+}
+
+// Copies the contents of `string` into `dst`, which must have room for all of it.
+static void copy_rope(const struct kn_string *string, char *dst) {
+	while (is_rope(string)) {
+		copy_rope(string->rope.left, dst);
+		dst += kn_length(string->rope.left);
+		string = string->rope.right;
+	}
+
+	memcpy(dst, kn_string_deref(string), kn_length(string));
+}
+
+void kn_string_flatten(struct kn_string *string) {
+	assert(is_rope(string));
+
+	size_t length = kn_length(string);
+	char *ptr = kn_heap_malloc(length);
+	struct kn_string *left = string->rope.left, *right = string->rope.right;
+
+	copy_rope(string, ptr);
+
+	kn_flags(string) &= ~KN_STRING_FL_ROPE;
+	string->ptr = ptr;
+	string->capacity = length;
+
+	kn_string_free(left);
+	kn_string_free(right);
+}
+
+#ifdef KN_USE_GC
+void kn_string_mark(const struct kn_string *string) {
+	if (is_rope(string)) {
+		kn_gc_mark(string->rope.left);
+		kn_gc_mark(string->rope.right);
+	} else if (kn_flags(string) & KN_STRING_FL_SLICE) {
+		kn_gc_mark(string->parent);
+	}
+}
+#endif /* KN_USE_GC */
+
+// Creates a slice of `length` bytes of `parent`, starting at `start`; takes ownership of `parent`.
+static struct kn_string *allocate_slice_string(
+	struct kn_string *parent,
+	size_t start,
+	size_t length
+) {
+	assert(!(kn_flags(parent) & (KN_STRING_FL_ROPE | KN_STRING_FL_EMBED)));
+
+	// Slices always point into the string that owns the data, so they never form chains.
+	if (kn_flags(parent) & KN_STRING_FL_SLICE) {
+		struct kn_string *grandparent = kn_string_clone(parent->parent);
+
+		start += parent->ptr - kn_string_deref(grandparent);
+		kn_string_free(parent);
+		parent = grandparent;
+	}
+
+#ifdef KN_USE_GC
+	struct kn_string *string = kn_gc_malloc(struct kn_string, KN_GC_KIND_STRING);
+#else
+	struct kn_string *string = kn_heap_alloc(struct kn_string);
+#endif /* KN_USE_GC */
+
+	kn_flags(string) = KN_STRING_FL_STRUCT_ALLOC | KN_STRING_FL_SLICE;
+	string->length = length;
+	string->ptr = kn_string_deref(parent) + start;
+	string->parent = parent;
+
+#ifdef KN_USE_REFCOUNT
+	string->refcount = 1;
+#endif /* KN_USE_REFCOUNT */
+
+	return string;
+}
+
 struct kn_string *kn_string_concat(
 	struct kn_string *lhs, 
 	struct kn_string *rhs
@@ -340,7 +1117,7 @@ struct kn_string *kn_string_concat(
 #else
 		kn_string_free(lhs); // this is the replacement to work.
 #endif
-		return kn_string_clone_static(rhs);
+		return rhs;
 	}
 
 	if ((rhslen = kn_length(rhs)) == 0) {
@@ -352,31 +1129,53 @@ struct kn_string *kn_string_concat(
 		return lhs;
 	}
 
-	kn_hash_t hash = kn_hash(kn_string_deref(lhs), lhslen);
-	hash = kn_hash_acc(kn_string_deref(rhs), rhslen, hash);
+#ifdef KN_USE_REFCOUNT
+	// If nothing else can see `lhs`, we can just append onto it. Cached strings are excluded, as
+	// the cache is keyed by their contents, as are slices, which don't own their data. (Static
+	// strings are never `STRUCT_ALLOC`.)
+	if (
+		lhs->refcount == 1
+		&& (kn_flags(lhs) & (KN_STRING_FL_STRUCT_ALLOC | KN_STRING_FL_ROPE | KN_STRING_FL_SLICE))
+			== KN_STRING_FL_STRUCT_ALLOC
+# ifdef KN_STRING_CACHE
+		&& !(kn_flags(lhs) & KN_STRING_FL_CACHED)
+# endif /* KN_STRING_CACHE */
+	) {
+		append_in_place(lhs, kn_string_deref(rhs), rhslen);
+		kn_string_free(rhs);
+		return lhs;
+	}
+#endif /* KN_USE_REFCOUNT */
+
+	if (KN_STRING_ROPE_MIN_LENGTH <= lhslen + rhslen)
+		return concat_rope(lhs, rhs);
 
 	size_t length = lhslen + rhslen;
 
 	struct kn_string *string;
 
 #ifdef KN_STRING_CACHE
-	string = kn_string_cache_lookup(hash, length);
-	if (string == NULL)
+	kn_hash_t hash = 0;
+
+	// Strings too long to be cached aren't worth hashing.
+	if (KN_STRING_CACHE_MAXLEN < length)
 		goto allocate_and_cache;
 
-	char *cached = kn_string_deref(string);
-	char *tmp = kn_string_deref(lhs);
+	struct kn_hash_state hash_state;
+	kn_hash_start(&hash_state);
+	kn_hash_acc(&hash_state, kn_string_deref(lhs), lhslen);
+	kn_hash_acc(&hash_state, kn_string_deref(rhs), rhslen);
+	hash = kn_hash_finish(&hash_state);
 
-	// FIXME: use memcmp instead
-	for (size_t i = 0; i < lhslen; i++, cached++)
-		if (*cached != tmp[i])
-			goto allocate_and_cache;
+	string = kn_string_cache_lookup(hash, length);
+	if (string == NULL)
+		goto allocate_and_cache;
 
-	tmp = kn_string_deref(rhs);
+	const char *cached = kn_string_deref(string);
 
-	for (size_t i = 0; i < rhslen; i++, cached++)
-		if (*cached != tmp[i])
-			goto allocate_and_cache;
+	if (memcmp(cached, kn_string_deref(lhs), lhslen) != 0
+		|| memcmp(cached + lhslen, kn_string_deref(rhs), rhslen) != 0)
+		goto allocate_and_cache;
 
 	string = kn_string_clone(string);
 	goto free_and_return;
@@ -389,10 +1188,10 @@ allocate_and_cache:
 
 	memcpy(str, kn_string_deref(lhs), lhslen);
 	memcpy(str + lhslen, kn_string_deref(rhs), rhslen);
-	str[length] = '\0';
 
 #ifdef KN_STRING_CACHE
-	kn_string_cache(string);
+	if (length <= KN_STRING_CACHE_MAXLEN)
+		cache_string(string, hash);
 free_and_return:
 #endif /* KN_STRING_CACHE */
 
@@ -427,8 +1226,6 @@ struct kn_string *kn_string_repeat(struct kn_string *string, size_t amount) {
 	for (char *ptr = str; amount != 0; --amount, ptr += lhslen)
 		memcpy(ptr, kn_string_deref(string), lhslen);
 
-	str[length] = '\0';
-
 	kn_string_free(string);
 
 	return repeat;
@@ -451,7 +1248,37 @@ struct kn_string *kn_string_get_substring(
 	}
 
 	if (KN_UNLIKELY(!start && length == kn_length(string)))
-		return kn_string_clone_static(string);
+		return string;
+
+	// Walk down the rope until we find the piece that contains the substring, or until the
+	// substring spans both halves.
+	while (KN_UNLIKELY(is_rope(string))) {
+		struct kn_string *left, *right;
+		size_t left_length = kn_length(string->rope.left);
+
+		split_rope(string, &left, &right);
+
+		if (start + length <= left_length) {
+			kn_string_free(right);
+			string = left;
+		} else if (left_length <= start) {
+			kn_string_free(left);
+			string = right;
+			start -= left_length;
+		} else {
+			return kn_string_concat(
+				kn_string_get_substring(left, start, left_length - start),
+				kn_string_get_substring(right, 0, start + length - left_length)
+			);
+		}
+
+		if (!start && length == kn_length(string))
+			return string;
+	}
+
+	// Strings too long to embed are sliced rather than copied.
+	if (KN_STRING_EMBEDDED_LENGTH < length)
+		return allocate_slice_string(string, start, length);
 
 	struct kn_string *substring = kn_string_new_borrowed(
 		kn_string_deref(string) + start,
@@ -476,20 +1303,38 @@ struct kn_string *kn_string_set_substring(
 
 	if (KN_UNLIKELY(kn_length(string) == 0)) {
 		assert(string == &kn_string_empty);
-		return kn_string_clone_static(replacement);
+		return replacement;
+	}
+
+	// Rather than flattening ropes, build the result out of the pieces around the replacement.
+	if (KN_UNLIKELY(is_rope(string))) {
+		size_t end = start + length;
+		struct kn_string *prefix = kn_string_get_substring(kn_string_clone(string), 0, start);
+		struct kn_string *suffix = kn_string_get_substring(string, end, kn_length(string) - end);
+
+		return kn_string_concat(kn_string_concat(prefix, replacement), suffix);
 	}
 
 	char *string_str = kn_string_deref(string);
 	char *repl_str = kn_string_deref(replacement);
 
 	size_t replaced_length = kn_length(string) - length + kn_length(replacement);
-	kn_hash_t hash = kn_hash(string_str, start);
-	hash = kn_hash_acc(repl_str, kn_length(replacement), hash);
-	hash = kn_hash_acc(string_str + start + length, kn_length(string) - start - length, hash);
-
 	struct kn_string *cached;
 
 #ifdef KN_STRING_CACHE
+	kn_hash_t hash = 0;
+
+	// Strings too long to be cached aren't worth hashing.
+	if (KN_STRING_CACHE_MAXLEN < replaced_length)
+		goto allocate_and_cache;
+
+	struct kn_hash_state hash_state;
+	kn_hash_start(&hash_state);
+	kn_hash_acc(&hash_state, string_str, start);
+	kn_hash_acc(&hash_state, repl_str, kn_length(replacement));
+	kn_hash_acc(&hash_state, string_str + start + length, kn_length(string) - start - length);
+	hash = kn_hash_finish(&hash_state);
+
 	cached = kn_string_cache_lookup(hash, replaced_length);
 	if (
 		cached
@@ -504,6 +1349,8 @@ struct kn_string *kn_string_set_substring(
 		cached = kn_string_clone(cached);
 		goto free_and_return;
 	}
+
+allocate_and_cache:
 #endif /* KN_STRING_CACHE */
 
 	cached = kn_string_alloc(replaced_length);
@@ -511,11 +1358,11 @@ struct kn_string *kn_string_set_substring(
 
 	memcpy(str, string_str, start);
 	memcpy(str + start, repl_str, kn_length(replacement));
-	memcpy(str + start + kn_length(replacement), string_str + start + length, kn_length(string));
-	str[replaced_length] = '\0';
+	memcpy(str + start + kn_length(replacement), string_str + start + length, kn_length(string) - start - length);
 
 #ifdef KN_STRING_CACHE
-	kn_string_cache(cached);
+	if (replaced_length <= KN_STRING_CACHE_MAXLEN)
+		cache_string(cached, hash);
 free_and_return:
 #endif /* KN_STRING_CACHE */
 
@@ -35,11 +35,27 @@ enum {
 	KN_STRING_FL_EMBED = (1 << 1),
 
 	/*
-	 * Indicates that the string is a `static` string---that is, it's not
-	 * allocated, but should it should be fully duplicated when the function
-	 * `kn_string_clone_static` is called.
+	 * Indicates that the string is a `rope`: the concatenation of two other
+	 * strings, which haven't been copied into a contiguous buffer yet.
+	 *
+	 * Ropes are flattened into ordinary allocated strings the first time
+	 * `kn_string_deref` is called on them.
+	 */
+	KN_STRING_FL_ROPE = (1 << 4),
+
+	/*
+	 * Indicates that the string is a `slice` of another string: its `ptr`
+	 * points into the `parent`'s data, which it holds a reference to.
+	 *
 	 */
-	KN_STRING_FL_STATIC = (1 << 2)
+	KN_STRING_FL_SLICE = (1 << 5),
+
+	/*
+	 * Indicates that the string was returned by `kn_string_intern`. No two interned strings have
+	 * the same contents, so they're equal only if they're the same pointer. Interned strings live
+	 * until `kn_string_intern_teardown`, and are never deallocated before then.
+	 */
+	KN_STRING_FL_INTERNED = (1 << 6)
 
 #ifdef KN_STRING_CACHE
 	/*
@@ -49,6 +65,18 @@ enum {
 	, KN_STRING_FL_CACHED = (1 << 3)
 #endif /* KN_STRING_CACHE */
 
+#ifdef KN_CONTAINER_CACHE
+	/*
+	 * Indicates that `cached.hash` is the hash of the string's contents.
+	 */
+	, KN_STRING_FL_HASHED = (1 << 7)
+
+	/*
+	 * Indicates that `cached.integer` is what the string converts to as an integer.
+	 */
+	, KN_STRING_FL_INTEGER = (1 << 8)
+#endif /* KN_CONTAINER_CACHE */
+
 #ifdef KN_USE_GC
 	, KN_STRING_FL_MARK = KN_GC_FL_MARKED
 #endif /* KN_USE_GC */
@@ -62,14 +90,28 @@ enum {
 # define KN_STRING_PADDING_LENGTH 16
 #endif /* !KN_STRING_PADDING_LENGTH */
 
+/**
+ * Concatenations at least this long build a rope instead of copying both
+ * halves into a new string.
+ **/
+#ifndef KN_STRING_ROPE_MIN_LENGTH
+# define KN_STRING_ROPE_MIN_LENGTH 256
+#endif /* !KN_STRING_ROPE_MIN_LENGTH */
+
+/**
+ * How many bytes each chunk of the arena that interned strings are allocated from holds.
+ **/
+#ifndef KN_STRING_INTERN_ARENA_SIZE
+# define KN_STRING_INTERN_ARENA_SIZE (64 * 1024)
+#endif /* !KN_STRING_INTERN_ARENA_SIZE */
+
 /**
  * The length of the embedded segment of the string.
  **/
 #define KN_STRING_EMBEDDED_LENGTH \
 	(sizeof(size_t) \
 		+ sizeof(char *) \
-		+ sizeof(char [KN_STRING_PADDING_LENGTH]) \
-		- 1) // for null ptr
+		+ sizeof(char [KN_STRING_PADDING_LENGTH]))
 
 /**
  * The string type in Knight.
@@ -87,6 +129,15 @@ enum {
 struct kn_string {
 	KN_CONTAINER
 
+	/*
+	 * The string's hash and what it converts to as an integer, when `KN_STRING_FL_HASHED` and
+	 * `KN_STRING_FL_INTEGER` are set.
+	 */
+	KN_CONTAINER_CACHED({
+		kn_hash_t hash;
+		kn_integer integer;
+	})
+
 	/* All strings are either embedded or allocated. */
 	union {
 		/*
@@ -94,10 +145,33 @@ struct kn_string {
 		 */
 		char embed[KN_STRING_EMBEDDED_LENGTH];
 
+		struct {
+			/*
+			 * The data for an allocated string, or for a slice.
+			 */
+			char *ptr;
+
+			union {
+				/*
+				 * How many bytes `ptr` can hold, so that strings can be appended to in
+				 * place.
+				 */
+				size_t capacity;
+
+				/*
+				 * The string that a slice's `ptr` points into.
+				 */
+				struct kn_string *parent;
+			};
+		};
+
 		/*
-		 * The data for an allocated string.
+		 * The halves of a rope string, and how deep the tree below it is.
 		 */
-		char *ptr;
+		struct {
+			struct kn_string *left, *right;
+			size_t depth;
+		} rope;
 	};
 };
 
@@ -106,6 +180,15 @@ struct kn_string {
  **/
 extern struct kn_string kn_string_empty;
 
+/**
+ * The strings of a single byte, indexed by that byte.
+ *
+ * These are never deallocated, and strings of one byte that are copied from elsewhere (such as by
+ * `kn_string_new_borrowed` or `kn_string_to_list`) are always one of them. They're also interned,
+ * as `kn_string_intern` returns them for one-byte strings.
+ **/
+extern struct kn_string kn_string_bytes[256];
+
 /**
  * A macro to create a new embedded struct.
  *
@@ -145,7 +228,8 @@ struct kn_string *kn_string_alloc(size_t length);
  * Creates a new `kn_string` of the given length, and then initializes it to
  * `str`; the `str`'s ownership should be given given to this function.
  *
- * Note that `length` should equal `strlen(str)`.
+ * Note that `length` should be the length of `str`, which doesn't need to be
+ * followed by a `\0`.
  **/
 struct kn_string *kn_string_new_owned(char *str, size_t length);
 
@@ -159,6 +243,30 @@ struct kn_string *kn_string_new_owned(char *str, size_t length);
 struct kn_string *kn_string_new_borrowed(const char *str, size_t length);
 
 
+/**
+ * Returns the interned string with the same contents as the unowned `str` (of length `length`),
+ * interning a copy of it if there's none yet.
+ *
+ * This is used for string literals and variable names, which live as long as the program does.
+ * When `KN_STRING_CACHE` is enabled, interned strings are also cached, so that equal strings that
+ * are created at runtime are usually the interned one too.
+ **/
+struct kn_string *kn_string_intern(const char *str, size_t length);
+
+/**
+ * Lets `kn_string_intern` point strings that lie within `source` into it, rather than copying them.
+ *
+ * This is used for scripts that are mapped into memory, so `source` must stay valid and unchanged
+ * until `kn_string_intern_teardown`, which forgets it. Short strings are still copied, as they're
+ * embedded in the string itself.
+ **/
+void kn_string_intern_borrow(const char *source, size_t length);
+
+/**
+ * Frees every interned string, invalidating all pointers to them; called by `kn_shutdown`.
+ **/
+void KN_COLD kn_string_intern_teardown(void);
+
 #ifdef KN_STRING_CACHE
 /**
  * Caches a string, such that `kn_string_new_xxx` can possibly use the string
@@ -175,10 +283,61 @@ void kn_string_cache(struct kn_string *string);
  * This function's a bit hacky, and probably could be redesigned a bit better...
  **/
 struct kn_string *kn_string_cache_lookup(kn_hash_t hash, size_t length);
+
+/**
+ * The default amount of sets in the string cache; see `kn_string_cache_resize`.
+ **/
+# ifndef KN_STRING_CACHE_SETS
+#  define KN_STRING_CACHE_SETS (1 << 15)
+# endif /* !KN_STRING_CACHE_SETS */
+
+/**
+ * Statistics about how effective the string cache is.
+ **/
+struct kn_string_cache_stats {
+	size_t hits;      // lookups that found the string in the cache
+	size_t misses;    // lookups that didn't, and so created a new string
+	size_t evictions; // strings removed to make room for more recently used ones
+};
+
+/**
+ * Sets the amount of sets in the string cache, rounding it up to a power of two. Each set holds
+ * `KN_STRING_CACHE_WAYS` strings, and the least recently used one is evicted when it's full.
+ *
+ * Cached strings are moved into the new sets, evicting any that no longer fit. A `sets` of zero
+ * evicts every string and releases the cache's memory; `kn_startup` and `kn_shutdown` call this.
+ **/
+void kn_string_cache_resize(size_t sets);
+
+/**
+ * The largest amount of sets that can be passed to `kn_string_cache_resize`, so that the cache's
+ * size in bytes doesn't overflow a `size_t`.
+ **/
+size_t kn_string_cache_max_sets(void);
+
+/**
+ * Returns the string cache's statistics.
+ **/
+struct kn_string_cache_stats kn_string_cache_stats(void);
+
+/**
+ * Prints the string cache's statistics to `out`.
+ **/
+void kn_string_cache_dump_stats(FILE *out);
 #endif /* KN_STRING_CACHE */
 
+/**
+ * Copies a rope's contents into a contiguous buffer, turning it into an
+ * ordinary allocated string.
+ *
+ * This is called automatically by `kn_string_deref`.
+ **/
+void kn_string_flatten(struct kn_string *string);
+
 /**
  * Dereferences the string, returning a mutable/immutable pointer to its data.
+ *
+ * If the string is a rope, it's flattened first.
  **/
 #define kn_string_deref(x) (_Generic(x,             \
 	const struct kn_string *: kn_string_deref_const, \
@@ -186,6 +345,9 @@ struct kn_string *kn_string_cache_lookup(kn_hash_t hash, size_t length);
 	)(x))
 
 static inline char *kn_string_deref_mut(struct kn_string *string) {
+	if (KN_UNLIKELY(kn_flags(string) & KN_STRING_FL_ROPE))
+		kn_string_flatten(string);
+
 	return KN_LIKELY(kn_flags(string) & KN_STRING_FL_EMBED)
 		? string->embed
 		: string->ptr;
@@ -194,6 +356,10 @@ static inline char *kn_string_deref_mut(struct kn_string *string) {
 static inline const char *kn_string_deref_const(
 	const struct kn_string *string
 ) {
+	// Flattening doesn't change the string's contents, just how they're stored.
+	if (KN_UNLIKELY(kn_flags(string) & KN_STRING_FL_ROPE))
+		kn_string_flatten(KN_CLANG_IGNORE("-Wcast-qual", (struct kn_string *) string));
+
 	return KN_LIKELY(kn_flags(string) & KN_STRING_FL_EMBED)
 		? string->embed
 		: string->ptr;
@@ -206,8 +372,6 @@ static inline const char *kn_string_deref_const(
  * memory errors occur.
  **/
 static inline struct kn_string *kn_string_clone(struct kn_string *string) {
-	assert(!(kn_flags(string) & KN_STRING_FL_STATIC));
-
 #ifdef KN_USE_REFCOUNT
 	++string->refcount; // this is irrelevant for non-allocated structs.
 #endif /* KN_USE_REFCOUNT */
@@ -215,19 +379,11 @@ static inline struct kn_string *kn_string_clone(struct kn_string *string) {
 	return string;
 }
 
-/**
- * Duplicates `KN_STRING_FL_STATIC` strings, simply returns all others.
- *
- * This is intended to be used for strings that are `static`---they normally
- * don't need to be heap-allocated (eg if they're simply being printed out), but
- * if an entire new string is needed, this is used to ensure that the returned
- * string won't change if the original static one does.
- **/
-struct kn_string *kn_string_clone_static(struct kn_string *string);
-
 /**
  * Deallocates the memory associated with `string`; should only be called with
  * a string with a zero refcount.
+ *
+ * When using `KN_USE_GC`, this is only called by the collector, and doesn't free the struct itself.
  **/
 void kn_string_dealloc(struct kn_string *string);
 
@@ -249,11 +405,25 @@ static inline void kn_string_free(struct kn_string *string) {
 #endif /* !KN_USE_REFCOUNT */
 }
 
+#ifdef KN_USE_GC
+/**
+ * Marks the halves of a rope, or the parent of a slice, as reachable; other strings don't
+ * reference anything.
+ **/
+void kn_string_mark(const struct kn_string *string);
+#endif /* KN_USE_GC */
+
 /**
  * Checks to see if two strings have the same contents.
+ *
+ * Ropes are compared piece by piece, without flattening them.
  **/
 bool kn_string_equal(const struct kn_string *lhs, const struct kn_string *rhs);
 
+/**
+ * Compares two strings' bytes lexicographically, returning a negative number, zero, or a positive
+ * number if `lhs` is less than, equal to, or greater than `rhs`.
+ **/
 kn_integer kn_string_compare(const struct kn_string *lhs, const struct kn_string *rhs);
 
 /**
@@ -261,13 +431,20 @@ kn_integer kn_string_compare(const struct kn_string *lhs, const struct kn_string
  *
  * This means we strip all leading whitespace, and then an optional `-` or `+`
  * may appear (`+` is ignored, `-` indicates a negative integer). Then as many
- * digits as possible are read.
+ * digits as possible are read. Only the string's `length` bytes are examined.
  **/
-static inline kn_integer kn_string_to_integer(const struct kn_string *string) {
-	return strtoll(kn_string_deref(string), NULL, 10);
-}
+kn_integer kn_string_to_integer(const struct kn_string *string);
 
 struct kn_list *kn_string_to_list(const struct kn_string *string);
+
+/**
+ * Concatenates `lhs` and `rhs`, taking ownership of both.
+ *
+ * When using `KN_USE_REFCOUNT`, if `lhs` is an uncached string with no other references, `rhs`
+ * is appended to it in place (reallocating its buffer geometrically when needed) and `lhs` is
+ * returned. Otherwise, if the result is at least `KN_STRING_ROPE_MIN_LENGTH` long, a balanced
+ * rope is returned instead of copying either side.
+ **/
 struct kn_string *kn_string_concat(struct kn_string *lhs, struct kn_string *rhs);
 struct kn_string *kn_string_repeat(struct kn_string *string, size_t amount);
 struct kn_string *kn_string_get_substring(struct kn_string *string, size_t start, size_t length);
@@ -3,7 +3,7 @@
 #include "value.h"  /* prototypes, bool, uint64_t, int64_t, kn_value, kn_integer,
                        kn_boolean, KN_UNDEFINED, KN_NULL, KN_TRUE, KN_FALSE */
 #include "string.h" /* kn_string, kn_string_clone, kn_string_dealloc,
-                       kn_string_deref, kn_string_length, KN_STRING_FL_STATIC,
+                       kn_string_deref, kn_string_length,
                        KN_STRING_NEW_EMBED */
 #include "custom.h" /* kn_custom, kn_custom_free, kn_custom_clone */
 #include "integer.h" /* kn_integer_to_string */
@@ -202,8 +202,16 @@ bool kn_value_equal(kn_value lhs, kn_value rhs) {
 		return false;
 
 	switch (kn_tag(lhs)) {
-	case KN_TAG_STRING:
-		return kn_string_equal(kn_value_as_string(lhs), kn_value_as_string(rhs));
+	case KN_TAG_STRING: {
+		const struct kn_string *lstring = kn_value_as_string(lhs);
+		const struct kn_string *rstring = kn_value_as_string(rhs);
+
+		// Different interned strings never have the same contents, so don't bother calling.
+		if (kn_flags(lstring) & kn_flags(rstring) & KN_STRING_FL_INTERNED)
+			return false;
+
+		return kn_string_equal(lstring, rstring);
+	}
 
 	case KN_TAG_LIST:
 		return kn_list_equal(kn_value_as_list(lhs), kn_value_as_list(rhs));
@@ -380,17 +388,14 @@ void kn_value_mark(kn_value value) {
 	case KN_TAG_INTEGER:
 		return;
 
-	case KN_TAG_STRING:
-		return;
-
-	case KN_TAG_LIST:
-		return;
-
+	// Variables live in the environment, which is marked separately.
 	case KN_TAG_VARIABLE:
 		return;
 
+	case KN_TAG_STRING:
+	case KN_TAG_LIST:
 	case KN_TAG_AST:
-		kn_ast_mark(kn_value_as_ast(value));
+		kn_gc_mark((const void *) KN_UNMASK(value));
 		return;
 
 #ifdef KN_CUSTOM
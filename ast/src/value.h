@@ -355,7 +355,7 @@ static inline size_t kn_container_length(kn_value value) {
 static inline size_t *kn_container_refcount(kn_value value) {
 	assert(kn_value_is_ast(value) || kn_value_is_string(value) || kn_value_is_list(value));
 
-	return ((struct { KN_HEADER } *)KN_UNMASK(value))->refcount;
+	return &((struct { KN_HEADER } *)KN_UNMASK(value))->refcount;
 }
 #endif /* KN_USE_REFCOUNT */
 
@@ -405,6 +405,9 @@ static inline void kn_value_free(kn_value value) {
 }
 
 #ifdef KN_USE_GC
+/**
+ * Marks `value` as reachable, so that the next collection won't reclaim it.
+ **/
 void kn_value_mark(kn_value value);
 #endif
 
@@ -8,21 +8,41 @@
 typedef unsigned long long kn_hash_int;
 
 /**
- * Computes the hash of the first `length` characters of `str`, with the given
- * starting `hash`.
+ * The state of a hash that's being computed a piece at a time.
+ *
+ * Strings are hashed eight bytes at a time, so the bytes of an incomplete word
+ * are kept in `tail` until the next piece completes it. That way, hashing a
+ * string in pieces gives the same result as hashing it all at once.
+ **/
+struct kn_hash_state {
+	kn_hash_int hash;
+	unsigned long long tail;
+	size_t length;
+};
+
+/**
+ * Starts computing a hash a piece at a time.
+ **/
+void kn_hash_start(struct kn_hash_state *KN_NONNULL state);
+
+/**
+ * Adds the first `length` characters of `str` to the hash.
  *
  * This is useful to compute hashes of non-sequential strings.
  **/
-kn_hash_int kn_hash_acc(const char *KN_NONNULL str, size_t length, kn_hash_int hash);
+void kn_hash_acc(struct kn_hash_state *KN_NONNULL state, const char *str, size_t length);
+
+/**
+ * Returns the hash of everything given to `kn_hash_acc`, which is the same as
+ * `kn_hash` of all of it at once.
+ **/
+kn_hash_int kn_hash_finish(const struct kn_hash_state *KN_NONNULL state);
 
 /**
  * Returns a hash for the first `length` characters of `str`.
  *
- * `str` must be at least `length` characters long, excluding any trailing `\0`
+ * `str` must be at least `length` characters long.
  **/
-static inline kn_hash_int kn_hash(const char *KN_NONNULL str, size_t length) {
-	// start a `kn_hash_acc` with the default starting value
-	return kn_hash_acc(str, length, 525201411107845655L);
-}
+kn_hash_int kn_hash(const char *str, size_t length);
 
 #endif
@@ -1,18 +1,115 @@
 #include "hash.h"
 #include "debug.h"
+extern void *memcpy(void *, const void *, unsigned long);
 
-kn_hash_int kn_hash_acc(const char *str, size_t length, kn_hash_int hash) {
-	kn_assert_nonnull(str);
+/*
+ * Strings are hashed a word at a time, using xxHash64's round and avalanche functions on a single
+ * accumulator (as the strings that are hashed are generally short). Words are read in
+ * little-endian order, so that whole words hash the same as ones built a byte at a time in `tail`.
+ */
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+#define SEED 525201411107845655ULL
 
-	// This is MurmurHash.
-	while (length--) {
-		// make sure not EOS before `length` is over.
-		kn_assert_ne(*str, '\0');
+static inline kn_hash_int hash_round(kn_hash_int hash, unsigned long long word) {
+	hash += word * PRIME2;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * PRIME1;
+}
 
-		hash ^= *str++;
-		hash *= 0x5bd1e9955bd1e995;
-		hash ^= hash >> 47;
-	}
+static inline unsigned long long load_word(const char *str) {
+	unsigned long long word;
+	memcpy(&word, str, sizeof(word));
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	word = __builtin_bswap64(word);
+#endif /* __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ */
+
+	return word;
+}
+
+static inline unsigned long long load_half_word(const char *str) {
+	return (unsigned long long) (unsigned char) str[0]
+		| (unsigned long long) (unsigned char) str[1] << 8
+		| (unsigned long long) (unsigned char) str[2] << 16
+		| (unsigned long long) (unsigned char) str[3] << 24;
+}
+
+// Reads the `length` (which is less than 8) bytes at `str` as a little-endian word. Instead of a
+// loop, this is done with loads that overlap each other; the overlapping bytes are identical.
+static inline unsigned long long load_partial_word(const char *str, size_t length) {
+	kn_assert(0 < length && length < 8);
+
+	if (4 <= length)
+		return load_half_word(str) | load_half_word(str + length - 4) << ((length - 4) * 8);
+
+	return (unsigned long long) (unsigned char) str[0]
+		| (unsigned long long) (unsigned char) str[length / 2] << (length / 2 * 8)
+		| (unsigned long long) (unsigned char) str[length - 1] << ((length - 1) * 8);
+}
+
+// Mixes in the last, incomplete, word (if any) and the total length, and then avalanches the bits.
+static inline kn_hash_int hash_finish(kn_hash_int hash, unsigned long long tail, size_t length) {
+	// Since `tail * PRIME1` and the avalanche are both invertible, strings of the same length that are
+	// no more than eight bytes long never collide.
+	hash += length * PRIME5;
+	hash ^= tail * PRIME1;
+
+	hash ^= hash >> 33;
+	hash *= PRIME2;
+	hash ^= hash >> 29;
+	hash *= PRIME3;
+	hash ^= hash >> 32;
 
 	return hash;
 }
+
+void kn_hash_start(struct kn_hash_state *state) {
+	state->hash = SEED;
+	state->tail = 0;
+	state->length = 0;
+}
+
+void kn_hash_acc(struct kn_hash_state *state, const char *str, size_t length) {
+	kn_assert(str != NULL || length == 0);
+
+	size_t tail_length = state->length % 8;
+	state->length += length;
+
+	// Complete the word left over from the previous piece first.
+	if (tail_length != 0) {
+		for (; length != 0 && tail_length != 8; --length, ++tail_length)
+			state->tail |= (unsigned long long) (unsigned char) *str++ << (tail_length * 8);
+
+		if (tail_length != 8)
+			return;
+
+		state->hash = hash_round(state->hash, state->tail);
+		state->tail = 0;
+	}
+
+	for (; 8 <= length; str += 8, length -= 8)
+		state->hash = hash_round(state->hash, load_word(str));
+
+	if (length != 0)
+		state->tail = load_partial_word(str, length);
+}
+
+kn_hash_int kn_hash_finish(const struct kn_hash_state *state) {
+	return hash_finish(state->hash, state->tail, state->length);
+}
+
+// The same as `kn_hash_start`, `kn_hash_acc`, and `kn_hash_finish`, without the bookkeeping.
+kn_hash_int kn_hash(const char *str, size_t length) {
+	kn_assert(str != NULL || length == 0);
+
+	kn_hash_int hash = SEED;
+	size_t remaining = length;
+
+	for (; 8 <= remaining; str += 8, remaining -= 8)
+		hash = hash_round(hash, load_word(str));
+
+	return hash_finish(hash, remaining != 0 ? load_partial_word(str, remaining) : 0, length);
+}
@@ -359,14 +359,17 @@ struct kn_string *kn_string_concat(
 		return lhs;
 	}
 
-	kn_hash_int hash = kn_hash(kn_string_deref(lhs), lhslen);
-	hash = kn_hash_acc(kn_string_deref(rhs), rhslen, hash);
-
 	size_t length = lhslen + rhslen;
 
 	struct kn_string *string;
 
 #ifdef KN_STRING_CACHE
+	struct kn_hash_state hash_state;
+	kn_hash_start(&hash_state);
+	kn_hash_acc(&hash_state, kn_string_deref(lhs), lhslen);
+	kn_hash_acc(&hash_state, kn_string_deref(rhs), rhslen);
+	kn_hash_int hash = kn_hash_finish(&hash_state);
+
 	string = kn_string_cache_lookup(hash, length);
 	if (string == NULL)
 		goto allocate_and_cache;
@@ -490,13 +493,16 @@ struct kn_string *kn_string_set_substring(
 	char *repl_str = kn_string_deref(replacement);
 
 	size_t replaced_length = kn_length(string) - length + kn_length(replacement);
-	kn_hash_int hash = kn_hash(string_str, start);
-	hash = kn_hash_acc(repl_str, kn_length(replacement), hash);
-	hash = kn_hash_acc(string_str + start + length, kn_length(string) - start - length, hash);
-
 	struct kn_string *cached;
 
 #ifdef KN_STRING_CACHE
+	struct kn_hash_state hash_state;
+	kn_hash_start(&hash_state);
+	kn_hash_acc(&hash_state, string_str, start);
+	kn_hash_acc(&hash_state, repl_str, kn_length(replacement));
+	kn_hash_acc(&hash_state, string_str + start + length, kn_length(string) - start - length);
+	kn_hash_int hash = kn_hash_finish(&hash_state);
+
 	cached = kn_string_cache_lookup(hash, replaced_length);
 	if (
 		cached